@@ -0,0 +1,148 @@
+/**
+ * @file clear_bandwidth.cpp
+ * @author Gonzalo Perez Chamarro
+ * @brief Mide el ancho de banda de Rasterizer::clear() frente a memset() con varias resoluciones y formatos
+ * @version 0.1
+ * @date 2019-03-10
+ *
+ * @copyright Copyright (c) 2019
+ *
+ */
+
+#include "Color_Buffer_Rgba8888.hpp"
+#include "Color_Buffer_Rgb565.hpp"
+#include "Rasterizer.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+
+using namespace example;
+
+namespace
+{
+
+    const double minimum_seconds = 0.25;
+
+    /**
+     * @brief Repite clear hasta que pasan al menos minimum_seconds y devuelve los GB/s que supone
+     * escribir bytes en cada repetición
+     *
+     */
+    template< class CLEAR >
+    double measure (size_t bytes, const CLEAR & clear)
+    {
+        typedef std::chrono::steady_clock Clock;
+
+        clear ();                                               // Las páginas se tocan antes de medir
+
+        size_t            repetitions = 0;
+        Clock::time_point start       = Clock::now ();
+        double            seconds     = 0;
+
+        do
+        {
+            clear ();
+
+            repetitions++;
+            seconds = std::chrono::duration< double >(Clock::now () - start).count ();
+        }
+        while (seconds < minimum_seconds);
+
+        return (double(bytes) * repetitions / seconds / 1e9);
+    }
+
+    template< class COLOR_BUFFER, class DEPTH_FORMAT >
+    void benchmark (const char * format, size_t width, size_t height)
+    {
+        typedef Rasterizer< COLOR_BUFFER, RASTERIZER_ENGINE, DEPTH_FORMAT > Target_Rasterizer;
+        typedef typename COLOR_BUFFER::Color                                 Color;
+        typedef typename DEPTH_FORMAT::Stored                                Depth;
+
+        COLOR_BUFFER      color_buffer(width, height);
+        Target_Rasterizer rasterizer  (color_buffer);
+
+        size_t            pixels      = width * height;
+        size_t            bytes       = pixels * (sizeof(Color) + sizeof(Depth));
+        size_t            threads     = std::max< size_t >(std::thread::hardware_concurrency (), 1);
+
+        // memset() sobre dos buffers del mismo tamaño que el de color y el z_buffer:
+
+        std::vector< uint8_t > color_bytes(pixels * sizeof(Color));
+        std::vector< uint8_t > depth_bytes(pixels * sizeof(Depth));
+
+        double memset_rate = measure
+        (
+            bytes,
+            [&] ()
+            {
+                std::memset (color_bytes.data (), 0x55, color_bytes.size ());
+                std::memset (depth_bytes.data (), 0xFF, depth_bytes.size ());
+            }
+        );
+
+        // fill_pattern() en un solo hilo, pasando por la caché y sin pasar por ella:
+
+        std::vector< Color > colors(pixels);
+        std::vector< Depth > depths(pixels);
+        Color                color;
+
+        color.set (0, 100, 255);
+
+        double cached_rate = measure
+        (
+            bytes,
+            [&] ()
+            {
+                fill_pattern (colors.data (), pixels, color, false);
+                fill_pattern (depths.data (), pixels, DEPTH_FORMAT::far_value (), false);
+            }
+        );
+
+        double streaming_rate = measure
+        (
+            bytes,
+            [&] ()
+            {
+                fill_pattern (colors.data (), pixels, color, true);
+                fill_pattern (depths.data (), pixels, DEPTH_FORMAT::far_value (), true);
+            }
+        );
+
+        // Rasterizer::clear(), que elige uno u otro según RASTERIZER_STREAMING_CLEAR_BYTES, con uno y con
+        // todos los hilos:
+
+        rasterizer.set_worker_count (1);
+
+        double clear_rate = measure (bytes, [&] () { rasterizer.clear (0, 100, 255); });
+
+        rasterizer.set_worker_count (threads);
+
+        double threaded_rate = measure (bytes, [&] () { rasterizer.clear (0, 100, 255); });
+
+        std::printf
+        (
+            "%-16s %5zux%-5zu %8.1f MB %8.2f %8.2f %8.2f %8.2f %8.2f (%zu)\n",
+            format, width, height, bytes / 1e6,
+            memset_rate, cached_rate, streaming_rate, clear_rate, threaded_rate, threads
+        );
+    }
+
+}
+
+int main ()
+{
+    static const size_t resolutions[][2] = { { 800, 600 }, { 1920, 1080 }, { 3840, 2160 }, { 7680, 4320 } };
+
+    std::printf ("GB/s escritos en el buffer de color y en el z_buffer (streaming a partir de %zu bytes)\n\n", size_t(RASTERIZER_STREAMING_CLEAR_BYTES));
+    std::printf ("%-16s %11s %11s %8s %8s %8s %8s %8s\n", "formato", "resolucion", "tamano", "memset", "cached", "stream", "clear", "clear MT");
+
+    for (auto & resolution : resolutions)
+    {
+        benchmark< Color_Buffer_Rgba8888, Depth_Int32   > ("rgba8888+int32" , resolution[0], resolution[1]);
+        benchmark< Color_Buffer_Rgb565  , Depth_Unorm16 > ("rgb565+unorm16" , resolution[0], resolution[1]);
+    }
+
+    return (EXIT_SUCCESS);
+}
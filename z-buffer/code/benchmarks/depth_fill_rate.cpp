@@ -0,0 +1,198 @@
+/**
+ * @file depth_fill_rate.cpp
+ * @author Gonzalo Perez Chamarro
+ * @brief Mide la tasa de relleno de los dos motores con cada formato de z_buffer, con triángulos
+ * enviados de atrás a delante, de delante a atrás y al azar
+ * @version 0.1
+ * @date 2019-03-10
+ *
+ * @copyright Copyright (c) 2019
+ *
+ */
+
+#include "Color_Buffer_Rgba8888.hpp"
+#include "Rasterizer.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <thread>
+#include <vector>
+
+using namespace example;
+
+namespace
+{
+
+    const double minimum_seconds = 0.25;
+    const size_t width           = 1920;
+    const size_t height          = 1080;
+    const size_t triangles       = 40000;
+
+    typedef Color_Buffer_Rgba8888::Color Color;
+
+    enum Order
+    {
+        BACK_TO_FRONT,                                          // Casi todos los pixels pasan y se escriben
+        FRONT_TO_BACK,                                          // Casi todos se comparan y se descartan
+        RANDOM_ORDER
+    };
+
+    struct Scene
+    {
+        std::vector< Point4i > vertices;
+        std::vector< int     > indices;
+        std::vector< Color   > colors;
+    };
+
+    /**
+     * @brief Triángulos de 16 a 64 pixels de lado, cada uno con Z constante, en el orden pedido.
+     * Cubren unas once veces la pantalla, de modo que casi todo el tiempo se pasa en el test de
+     * profundidad y no en la preparación de los triángulos.
+     *
+     */
+    Scene make_scene (Order order)
+    {
+        std::mt19937                             random(12345);
+        std::uniform_real_distribution< double > unit  (0.0, 1.0);
+        std::vector< int >                       depths(triangles);
+        Scene                                    scene;
+
+        for (int & z : depths) z = int(depth_max / 4 + unit (random) * depth_max / 2);
+
+        if (order == BACK_TO_FRONT) std::sort (depths.begin (), depths.end (), std::greater< int >());
+        if (order == FRONT_TO_BACK) std::sort (depths.begin (), depths.end ());
+
+        for (int z : depths)
+        {
+            double size  = 16 * std::pow (4.0, unit (random));
+            double x     = unit (random) * width;
+            double y     = unit (random) * height;
+            double angle = unit (random) * 6.2831853;
+
+            for (int corner = 0; corner < 3; ++corner, angle += 2.0943951)
+            {
+                Point4i vertex;
+
+                vertex[0] = int(std::floor ((x + std::cos (angle) * size * 0.577) * Rasterizer< Color_Buffer_Rgba8888 >::subpixel_size));
+                vertex[1] = int(std::floor ((y + std::sin (angle) * size * 0.577) * Rasterizer< Color_Buffer_Rgba8888 >::subpixel_size));
+                vertex[2] = z;
+                vertex[3] = 1;
+
+                scene.indices .push_back (int(scene.vertices.size ()));
+                scene.vertices.push_back (vertex);
+            }
+
+            Color color;
+
+            color.set (int(unit (random) * 255), int(unit (random) * 255), int(unit (random) * 255));
+
+            scene.colors.push_back (color);
+        }
+
+        return (scene);
+    }
+
+    /**
+     * @brief Repite el frame (clear, triángulos y flush) hasta que pasan al menos minimum_seconds.
+     * Devuelve los milisegundos por frame.
+     *
+     */
+    template< Raster_Engine ENGINE, class DEPTH_FORMAT >
+    double measure (const Scene & scene, size_t workers)
+    {
+        typedef std::chrono::steady_clock Clock;
+
+        Color_Buffer_Rgba8888                                       color_buffer(width, height);
+        Rasterizer< Color_Buffer_Rgba8888, ENGINE, DEPTH_FORMAT >   rasterizer  (color_buffer);
+
+        rasterizer.set_worker_count (workers);
+
+        auto frame = [&] ()
+        {
+            rasterizer.clear (0, 0, 0);
+            rasterizer.fill_triangles_z_buffer (scene.vertices.data (), scene.indices.data (), scene.colors.size (), scene.colors.data (), nullptr);
+            rasterizer.flush ();
+        };
+
+        frame ();                                               // Las páginas se tocan antes de medir
+
+        size_t            repetitions = 0;
+        Clock::time_point start       = Clock::now ();
+        double            seconds     = 0;
+
+        do
+        {
+            frame ();
+
+            repetitions++;
+            seconds = std::chrono::duration< double >(Clock::now () - start).count ();
+        }
+        while (seconds < minimum_seconds);
+
+        return (seconds * 1000 / repetitions);
+    }
+
+    /**
+     * @brief Mide los dos motores con un formato y los tres órdenes. La tasa de relleno se da en
+     * millones de pixels cubiertos por segundo, se escriban o no.
+     *
+     */
+    template< class DEPTH_FORMAT >
+    void benchmark (const char * format, const Scene (& scenes)[3], double covered_pixels, size_t threads)
+    {
+        static const char * const orders[] = { "atras-delante", "delante-atras", "azar" };
+
+        for (int order = 0; order < 3; ++order)
+        {
+            double scanline_ms   = measure< SCANLINE_ENGINE  , DEPTH_FORMAT > (scenes[order], 1      );
+            double half_space_ms = measure< HALF_SPACE_ENGINE, DEPTH_FORMAT > (scenes[order], 1      );
+            double scanline_mt   = measure< SCANLINE_ENGINE  , DEPTH_FORMAT > (scenes[order], threads);
+            double half_space_mt = measure< HALF_SPACE_ENGINE, DEPTH_FORMAT > (scenes[order], threads);
+
+            std::printf
+            (
+                "%-8s %-14s %4zu B %9.2f %9.2f %9.0f %9.0f %9.0f %9.0f\n",
+                format, orders[order], sizeof(typename DEPTH_FORMAT::Stored), scanline_ms, half_space_ms,
+                covered_pixels / scanline_ms   / 1e3, covered_pixels / half_space_ms / 1e3,
+                covered_pixels / scanline_mt   / 1e3, covered_pixels / half_space_mt / 1e3
+            );
+        }
+    }
+
+}
+
+int main ()
+{
+    const Scene scenes[3] = { make_scene (BACK_TO_FRONT), make_scene (FRONT_TO_BACK), make_scene (RANDOM_ORDER) };
+
+    // Los pixels cubiertos no dependen del orden ni del formato. Se cuentan con el pintado de atrás
+    // a delante y Depth_Int32, en el que cada pixel cubierto se escribe:
+
+    Color_Buffer_Rgba8888                                               color_buffer(width, height);
+    Rasterizer< Color_Buffer_Rgba8888, SCANLINE_ENGINE, Depth_Int32 >   rasterizer  (color_buffer);
+
+    rasterizer.clear (0, 0, 0);
+    rasterizer.fill_triangles_z_buffer (scenes[BACK_TO_FRONT].vertices.data (), scenes[BACK_TO_FRONT].indices.data (), triangles, scenes[BACK_TO_FRONT].colors.data (), nullptr);
+    rasterizer.flush ();
+
+    double covered_pixels = double(rasterizer.get_color_writes ());
+    size_t threads        = std::max< size_t >(std::thread::hardware_concurrency (), 1);
+
+    std::printf ("%zu triángulos de 16 a 64 pixels en %zux%zu: %.1f millones de pixels cubiertos por frame\n", triangles, width, height, covered_pixels / 1e6);
+    std::printf ("Milisegundos por frame con 1 hilo y millones de pixels por segundo con 1 y con %zu hilos\n\n", threads);
+    std::printf
+    (
+        "%-8s %-14s %6s %9s %9s %9s %9s %9s %9s\n",
+        "formato", "orden", "z", "scan ms", "half ms", "scan", "half", "scan MT", "half MT"
+    );
+
+    benchmark< Depth_Int32   > ("int32"  , scenes, covered_pixels, threads);
+    benchmark< Depth_Unorm16 > ("unorm16", scenes, covered_pixels, threads);
+    benchmark< Depth_Unorm24 > ("unorm24", scenes, covered_pixels, threads);
+    benchmark< Depth_Float32 > ("float32", scenes, covered_pixels, threads);
+
+    return (EXIT_SUCCESS);
+}
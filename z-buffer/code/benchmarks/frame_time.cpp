@@ -0,0 +1,366 @@
+/**
+ * @file frame_time.cpp
+ * @author Gonzalo Perez Chamarro
+ * @brief Mide el tiempo por frame de una escena completa y cuánto se lleva cada etapa, en JSON o CSV
+ * @version 0.1
+ * @date 2019-03-10
+ *
+ * @copyright Copyright (c) 2019
+ *
+ */
+
+#include "View.hpp"
+#include "Video_Sink.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace example;
+
+namespace
+{
+
+    struct Size
+    {
+        size_t width;
+        size_t height;
+    };
+
+    struct Options
+    {
+        std::string         scene;
+        std::vector< Size > sizes;                      // Se mide cada tamaño con una View nueva
+        size_t              frames;
+        size_t              warmup;                     // Frames que se pintan antes de empezar a medir
+        bool                tiled;                      // Buffers en tiles de 8x8 en lugar de por filas
+        bool                prepass;                    // Pasada previa de profundidad antes de sombrear
+        size_t              swap_chain;                 // Buffers de la cadena, o 0 para presentar en este hilo
+        bool                csv;
+    };
+
+    void print_usage (const char * program)
+    {
+        std::cerr << "uso: " << program << " [--scene escena.xml] [--size 800x600 | --sizes 1280x720,1920x1080] [--frames 300] [--warmup 10] [--tiled] [--prepass] [--swap-chain 3] [--format json|csv]" << std::endl;
+    }
+
+    bool parse_options (int argc, char ** argv, Options & options)
+    {
+        for (int index = 1; index < argc; ++index)
+        {
+            std::string option = argv[index];
+
+            if (option == "--tiled")
+            {
+                options.tiled = true;
+                continue;
+            }
+
+            if (option == "--prepass")
+            {
+                options.prepass = true;
+                continue;
+            }
+
+            if (index + 1 == argc) return (false);
+
+            std::string value = argv[++index];
+
+            if (option == "--scene" ) options.scene = value; else
+            if (option == "--format")
+            {
+                if (value != "json" && value != "csv") return (false);
+
+                options.csv = value == "csv";
+            }
+            else
+            if (option == "--frames")
+            {
+                if (std::sscanf (value.c_str (), "%zu", &options.frames) != 1 || options.frames == 0) return (false);
+            }
+            else
+            if (option == "--warmup")
+            {
+                if (std::sscanf (value.c_str (), "%zu", &options.warmup) != 1) return (false);
+            }
+            else
+            if (option == "--swap-chain")
+            {
+                if (std::sscanf (value.c_str (), "%zu", &options.swap_chain) != 1 || options.swap_chain == 1) return (false);
+            }
+            else
+            if (option == "--size" || option == "--sizes")
+            {
+                // --size admite un tamaño y --sizes una lista separada por comas:
+
+                options.sizes.clear ();
+
+                for (size_t begin = 0; begin <= value.size (); )
+                {
+                    size_t end  = std::min (value.find (',', begin), value.size ());
+                    Size   size = { 0, 0 };
+
+                    if (std::sscanf (value.substr (begin, end - begin).c_str (), "%zux%zu", &size.width, &size.height) != 2) return (false);
+                    if (size.width == 0 || size.height == 0) return (false);
+
+                    options.sizes.push_back (size);
+                    begin = end + 1;
+                }
+
+                if (option == "--size" && options.sizes.size () != 1) return (false);
+            }
+            else
+                return (false);
+        }
+
+        return (true);
+    }
+
+    /**
+     * @brief Percentil por el método del rango más cercano sobre muestras ya ordenadas
+     *
+     */
+    double percentile (const std::vector< double > & sorted, double fraction)
+    {
+        size_t rank = size_t(std::ceil (fraction * sorted.size ()));
+
+        return (sorted[std::min (std::max< size_t >(rank, 1), sorted.size ()) - 1]);
+    }
+
+    double median (const std::vector< double > & sorted)
+    {
+        size_t middle = sorted.size () / 2;
+
+        return (sorted.size () % 2 ? sorted[middle] : (sorted[middle - 1] + sorted[middle]) / 2);
+    }
+
+    /**
+     * @brief Escribe text entre comillas escapando lo que JSON no admite tal cual (las rutas de
+     * Windows llevan barras invertidas)
+     *
+     */
+    std::string json_string (const std::string & text)
+    {
+        std::string result = "\"";
+
+        for (char character : text)
+        {
+            if (character == '"' || character == '\\') result += '\\';
+
+            result += character;
+        }
+
+        return (result + "\"");
+    }
+
+    /**
+     * @brief Pinta options.frames frames de la escena con el tamaño size y escribe la medida en JSON o
+     * como una fila de CSV. Devuelve false si no se pudo cargar la escena.
+     *
+     */
+    bool measure (const Options & options, const Size & size)
+    {
+        View view(options.scene, size.width, size.height, options.tiled);
+
+        if (!view.is_loaded ())
+        {
+            std::cerr << "no se pudo cargar " << options.scene << std::endl;
+
+            return (false);
+        }
+
+        view.set_depth_prepass (options.prepass);
+
+        // Sin ventana no hay sincronización vertical, y cada update gira los modelos un paso fijo en lugar
+        // de según el tiempo transcurrido, de modo que cada ejecución pinta exactamente los mismos frames.
+        // Sin pipelining las etapas se ejecutan una detrás de otra en este hilo y suman el tiempo del frame.
+        //
+        // Cada frame se presenta copiándolo en RGBA, como hace Video_Sink antes de codificarlo. Sin cadena
+        // de buffers la copia se hace aquí después de pintarlo; con ella, en otro hilo mientras se pinta el
+        // siguiente, de modo que solo la diferencia en frames por segundo muestra lo que se gana:
+
+        typedef std::chrono::steady_clock Clock;
+
+        std::vector< uint32_t > image(size.width * size.height);
+        std::thread             presenter;
+
+        if (options.swap_chain)
+        {
+            view.set_swap_chain (options.swap_chain);
+
+            auto swap_chain = view.get_swap_chain ();
+
+            presenter = std::thread
+            (
+                [swap_chain, &image] ()
+                {
+                    while (auto frame = swap_chain->acquire_front ())
+                    {
+                        read_rgba (*frame, image.data ());
+
+                        swap_chain->release_front ();
+                    }
+                }
+            );
+        }
+
+        double present_ms = 0;
+
+        auto render = [&] ()
+        {
+            view.render_frame ();
+
+            if (options.swap_chain) return;
+
+            Clock::time_point present_start = Clock::now ();
+
+            read_rgba (view.get_color_buffer (), image.data ());
+
+            present_ms += std::chrono::duration< double, std::milli >(Clock::now () - present_start).count ();
+        };
+
+        for (size_t index = 0; index < options.warmup; ++index)
+        {
+            render ();
+        }
+
+        std::vector< double > frame_ms;
+        View::Frame_Timings   total        = View::Frame_Timings();
+        size_t                color_writes = 0;
+        Clock::time_point     start        = Clock::now ();
+
+        present_ms = 0;
+
+        for (size_t index = 0; index < options.frames; ++index)
+        {
+            render ();
+
+            const View::Frame_Timings & timings = view.get_frame_timings ();
+
+            frame_ms.push_back (timings.frame_ms);
+
+            total.transform_ms += timings.transform_ms;
+            total.culling_ms   += timings.culling_ms;
+            total.clear_ms     += timings.clear_ms;
+            total.raster_ms    += timings.raster_ms;
+
+            // Si el resultado cambia entre dos versiones, también cambia este recuento:
+
+            color_writes += view.get_color_writes ();
+        }
+
+        // La medida termina cuando se han presentado todos los frames:
+
+        if (presenter.joinable ())
+        {
+            view.get_swap_chain ()->close ();
+            presenter.join ();
+        }
+
+        double seconds = std::chrono::duration< double >(Clock::now () - start).count ();
+
+        std::vector< double > sorted(frame_ms);
+
+        std::sort (sorted.begin (), sorted.end ());
+
+        const char *               engine  = RASTERIZER_ENGINE == HALF_SPACE_ENGINE ? "half_space" : "scanline";
+        const char *               layout  = options.tiled ? "tiles" : "rows";
+        const char *               prepass = options.prepass ? "true" : "false";
+        const View::Load_Timings & load    = view.get_load_timings ();
+        double                     frames  = double(options.frames);
+        double                     mean    = 0;
+        unsigned                   threads = std::max (std::thread::hardware_concurrency (), 1u);
+
+        for (double sample : frame_ms) mean += sample / frames;
+
+        if (options.csv)
+        {
+            std::printf
+            (
+                "%s,%s,%s,%s,%zu,%zu,%zu,%u,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%zu,%.4f,%.2f,%zu\n",
+                options.scene.c_str (), engine, layout, prepass, size.width, size.height, options.frames, threads,
+                load.xml_ms, load.obj_ms,
+                sorted.front (), median (sorted), percentile (sorted, 0.99), mean,
+                total.transform_ms / frames, total.culling_ms / frames, total.clear_ms / frames, total.raster_ms / frames,
+                options.swap_chain, present_ms / frames, frames / seconds,
+                color_writes
+            );
+        }
+        else
+        {
+            std::printf
+            (
+                "{\n"
+                "    \"scene\": %s,\n"
+                "    \"engine\": \"%s\",\n"
+                "    \"layout\": \"%s\",\n"
+                "    \"depth_prepass\": %s,\n"
+                "    \"width\": %zu,\n"
+                "    \"height\": %zu,\n"
+                "    \"frames\": %zu,\n"
+                "    \"threads\": %u,\n"
+                "    \"load_ms\": { \"xml\": %.4f, \"obj\": %.4f },\n"
+                "    \"frame_ms\": { \"min\": %.4f, \"median\": %.4f, \"p99\": %.4f, \"mean\": %.4f },\n"
+                "    \"stage_mean_ms\": { \"transform_lighting\": %.4f, \"culling\": %.4f, \"clear\": %.4f, \"raster\": %.4f },\n"
+                "    \"swap_chain\": %zu,\n"
+                "    \"present_mean_ms\": %.4f,\n"
+                "    \"throughput_fps\": %.2f,\n"
+                "    \"color_writes\": %zu\n"
+                "}",
+                json_string (options.scene).c_str (), engine, layout, prepass, size.width, size.height, options.frames, threads,
+                load.xml_ms, load.obj_ms,
+                sorted.front (), median (sorted), percentile (sorted, 0.99), mean,
+                total.transform_ms / frames, total.culling_ms / frames, total.clear_ms / frames, total.raster_ms / frames,
+                options.swap_chain, present_ms / frames, frames / seconds,
+                color_writes
+            );
+        }
+
+        return (true);
+    }
+
+}
+
+int main (int argc, char ** argv)
+{
+    Options options = { "../resources/scene.xml", { { 800, 600 } }, 300, 10, false, false, 0, false };
+
+    if (!parse_options (argc, argv, options))
+    {
+        print_usage (argv[0]);
+
+        return (EXIT_FAILURE);
+    }
+
+    // En CSV hay una fila por tamaño bajo una sola cabecera. En JSON, un objeto, o una lista de ellos
+    // si se miden varios tamaños:
+
+    if (options.csv)
+    {
+        std::printf
+        (
+            "scene,engine,layout,depth_prepass,width,height,frames,threads,xml_ms,obj_ms,frame_min_ms,frame_median_ms,frame_p99_ms,frame_mean_ms,"
+            "transform_lighting_ms,culling_ms,clear_ms,raster_ms,swap_chain,present_mean_ms,throughput_fps,color_writes\n"
+        );
+    }
+
+    bool list = !options.csv && options.sizes.size () > 1;
+
+    if (list) std::printf ("[\n");
+
+    for (size_t index = 0; index < options.sizes.size (); ++index)
+    {
+        if (!measure (options, options.sizes[index])) return (EXIT_FAILURE);
+
+        if (!options.csv) std::printf (list && index + 1 < options.sizes.size () ? ",\n" : "\n");
+    }
+
+    if (list) std::printf ("]\n");
+
+    return (EXIT_SUCCESS);
+}
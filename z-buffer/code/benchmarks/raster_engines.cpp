@@ -0,0 +1,196 @@
+/**
+ * @file raster_engines.cpp
+ * @author Gonzalo Perez Chamarro
+ * @brief Compara SCANLINE_ENGINE y HALF_SPACE_ENGINE con varios tamaños de triángulo, con uno y con
+ * todos los hilos
+ * @version 0.1
+ * @date 2019-03-10
+ *
+ * @copyright Copyright (c) 2019
+ *
+ */
+
+#include "Color_Buffer_Rgba8888.hpp"
+#include "Rasterizer.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <thread>
+#include <vector>
+
+using namespace example;
+
+namespace
+{
+
+    const double minimum_seconds = 0.25;
+    const size_t width           = 1920;
+    const size_t height          = 1080;
+
+    typedef Color_Buffer_Rgba8888::Color Color;
+
+    /**
+     * @brief Triángulos al azar cuyo lado mide entre min_size y max_size pixels (con una distribución
+     * logarítmica, de modo que la mezcla tiene tantos pequeños como grandes)
+     *
+     */
+    struct Distribution
+    {
+        const char * name;
+        double       min_size;
+        double       max_size;
+        size_t       triangles;
+    };
+
+    struct Scene
+    {
+        std::vector< Point4i > vertices;
+        std::vector< int     > indices;
+        std::vector< Color   > colors;
+    };
+
+    Scene make_scene (const Distribution & distribution)
+    {
+        typedef Rasterizer< Color_Buffer_Rgba8888 > Any_Rasterizer;
+
+        std::mt19937                             random(12345);
+        std::uniform_real_distribution< double > unit  (0.0, 1.0);
+        Scene                                    scene;
+
+        for (size_t triangle = 0; triangle < distribution.triangles; ++triangle)
+        {
+            double size    = distribution.min_size * std::pow (distribution.max_size / distribution.min_size, unit (random));
+            double x       = unit (random) * width;
+            double y       = unit (random) * height;
+            double angle   = unit (random) * 6.2831853;
+            int    z       = int(depth_max / 4 + unit (random) * depth_max / 2);
+
+            for (int corner = 0; corner < 3; ++corner, angle += 2.0943951)
+            {
+                Point4i vertex;
+
+                vertex[0] = int(std::floor ((x + std::cos (angle) * size * 0.577) * Any_Rasterizer::subpixel_size));
+                vertex[1] = int(std::floor ((y + std::sin (angle) * size * 0.577) * Any_Rasterizer::subpixel_size));
+                vertex[2] = z + int(unit (random) * depth_max / 16);
+                vertex[3] = 1;
+
+                scene.indices .push_back (int(scene.vertices.size ()));
+                scene.vertices.push_back (vertex);
+            }
+
+            Color color;
+
+            color.set (int(unit (random) * 255), int(unit (random) * 255), int(unit (random) * 255));
+
+            scene.colors.push_back (color);
+        }
+
+        return (scene);
+    }
+
+    /**
+     * @brief Repite el frame (clear, triángulos y flush) hasta que pasan al menos minimum_seconds.
+     * Devuelve los milisegundos por frame y deja en colors el último buffer de color.
+     *
+     */
+    template< Raster_Engine ENGINE >
+    double measure (const Scene & scene, size_t workers, std::vector< Color > & colors, size_t & color_writes)
+    {
+        typedef std::chrono::steady_clock Clock;
+
+        Color_Buffer_Rgba8888                         color_buffer(width, height);
+        Rasterizer< Color_Buffer_Rgba8888, ENGINE >   rasterizer  (color_buffer);
+
+        rasterizer.set_worker_count (workers);
+
+        auto frame = [&] ()
+        {
+            rasterizer.clear (0, 0, 0);
+            rasterizer.fill_triangles_z_buffer (scene.vertices.data (), scene.indices.data (), scene.colors.size (), scene.colors.data (), nullptr);
+            rasterizer.flush ();
+        };
+
+        frame ();                                               // Las páginas se tocan antes de medir
+
+        size_t            repetitions = 0;
+        Clock::time_point start       = Clock::now ();
+        double            seconds     = 0;
+
+        do
+        {
+            frame ();
+
+            repetitions++;
+            seconds = std::chrono::duration< double >(Clock::now () - start).count ();
+        }
+        while (seconds < minimum_seconds);
+
+        colors.assign (color_buffer.colors (), color_buffer.colors () + width * height);
+        color_writes = rasterizer.get_color_writes ();
+
+        return (seconds * 1000 / repetitions);
+    }
+
+    void benchmark (const Distribution & distribution, size_t threads)
+    {
+        Scene scene = make_scene (distribution);
+
+        std::vector< Color > scanline_colors, half_space_colors;
+        size_t               writes = 0;
+
+        double scanline_ms      = measure< SCANLINE_ENGINE   > (scene, 1      , scanline_colors  , writes);
+        double half_space_ms    = measure< HALF_SPACE_ENGINE > (scene, 1      , half_space_colors, writes);
+        double scanline_mt_ms   = measure< SCANLINE_ENGINE   > (scene, threads, scanline_colors  , writes);
+        double half_space_mt_ms = measure< HALF_SPACE_ENGINE > (scene, threads, half_space_colors, writes);
+
+        // Los dos motores siguen la misma regla de relleno, así que solo difieren los pixels en los que
+        // dos triángulos tienen casi la misma Z, que cada motor redondea a su manera:
+
+        size_t different = 0;
+
+        for (size_t pixel = 0; pixel < scanline_colors.size (); ++pixel)
+        {
+            if (scanline_colors[pixel].data.value != half_space_colors[pixel].data.value) different++;
+        }
+
+        std::printf
+        (
+            "%-12s %8zu %9.2f %9.2f %9.2f %9.2f %9.2f %9.2f %10zu\n",
+            distribution.name, distribution.triangles, writes / 1e6,
+            scanline_ms, half_space_ms, scanline_mt_ms, half_space_mt_ms,
+            scanline_ms / half_space_ms, different
+        );
+    }
+
+}
+
+int main ()
+{
+    static const Distribution distributions[] =
+    {
+        { "1-4 px"    ,   1,   4, 400000 },
+        { "4-16 px"   ,   4,  16, 200000 },
+        { "16-64 px"  ,  16,  64,  40000 },
+        { "64-256 px" ,  64, 256,   4000 },
+        { "1-256 px"  ,   1, 256,  40000 },
+    };
+
+    size_t threads = std::max< size_t >(std::thread::hardware_concurrency (), 1);
+
+    std::printf ("Milisegundos por frame de %zux%zu (clear, triángulos y flush), con 1 y con %zu hilos\n\n", width, height, threads);
+    std::printf
+    (
+        "%-12s %8s %9s %9s %9s %9s %9s %9s %10s\n",
+        "lado", "tris", "Mpixels", "scanline", "half-sp", "scan MT", "half MT", "scan/half", "pixels !="
+    );
+
+    for (const Distribution & distribution : distributions)
+    {
+        benchmark (distribution, threads);
+    }
+
+    return (EXIT_SUCCESS);
+}
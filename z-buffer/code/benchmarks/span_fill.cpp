@@ -0,0 +1,173 @@
+/**
+ * @file span_fill.cpp
+ * @author Gonzalo Perez Chamarro
+ * @brief Mide las escrituras de spans de los buffers de color frente a set_pixel() virtual pixel a pixel
+ * @version 0.1
+ * @date 2019-03-10
+ *
+ * @copyright Copyright (c) 2019
+ *
+ */
+
+#include "Color_Buffer_Rgba8888.hpp"
+#include "Color_Buffer_Rgb565.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+using namespace example;
+
+namespace
+{
+
+    const double minimum_seconds = 0.2;
+
+    // 122880 pixels, que caben en la caché L2 con los dos formatos, para medir el coste de cada
+    // escritura y no el ancho de banda de la memoria:
+
+    const size_t width  = 512;
+    const size_t height = 240;
+
+    /**
+     * @brief Repite pass hasta que pasan al menos minimum_seconds y devuelve los millones de pixels
+     * por segundo, contando width * height pixels en cada repetición
+     *
+     */
+    template< class PASS >
+    double measure (const PASS & pass)
+    {
+        typedef std::chrono::steady_clock Clock;
+
+        pass ();
+
+        size_t            repetitions = 0;
+        Clock::time_point start       = Clock::now ();
+        double            seconds     = 0;
+
+        do
+        {
+            pass ();
+
+            repetitions++;
+            seconds = std::chrono::duration< double >(Clock::now () - start).count ();
+        }
+        while (seconds < minimum_seconds);
+
+        return (double(width * height) * repetitions / seconds / 1e6);
+    }
+
+    /**
+     * @brief Recorre el buffer entero en spans de length pixels seguidos, como los de un triángulo de
+     * ese ancho, y llama a write (offset, count) con cada uno
+     *
+     */
+    template< class WRITE >
+    void for_each_span (size_t length, const WRITE & write)
+    {
+        for (size_t y = 0; y < height; ++y)
+        {
+            for (size_t x = 0; x < width; x += length)
+            {
+                write (y * width + x, std::min (length, width - x));
+            }
+        }
+    }
+
+    template< class COLOR_BUFFER >
+    void benchmark (const char * format, size_t length)
+    {
+        typedef typename COLOR_BUFFER::Color Color;
+
+        COLOR_BUFFER         buffer(width, height);
+        Color                color;
+        std::vector< Color > colors(width);
+
+        color.set (0, 100, 255);
+
+        for (size_t index = 0; index < colors.size (); ++index) colors[index].set (int(index % 256), 0, 0);
+
+        buffer.set_color (color);
+
+        // El rasterizador pintaba antes cada pixel a través de la clase base. El puntero se lee de
+        // una variable volatile para que el compilador no pueda deducir el tipo y evitar la llamada virtual:
+
+        Color_Buffer * volatile base_pointer = &buffer;
+        Color_Buffer *          base         = base_pointer;
+
+        double set_pixel_rate = measure
+        (
+            [&] ()
+            {
+                for_each_span (length, [&] (size_t offset, size_t count) { for (size_t index = 0; index < count; ++index) base->set_pixel (offset + index); });
+            }
+        );
+
+        double fill_span_rate = measure
+        (
+            [&] ()
+            {
+                for_each_span (length, [&] (size_t offset, size_t count) { buffer.fill_span (offset, count, color); });
+            }
+        );
+
+        // fill_span_masked() recibe tramos de hasta 32 pixels, como en el rasterizador, con todos los
+        // pixels o con uno de cada dos (que cuentan igual como pixels del span):
+
+        auto masked = [&] (uint32_t pattern)
+        {
+            return measure
+            (
+                [&] ()
+                {
+                    for_each_span
+                    (
+                        length,
+                        [&] (size_t offset, size_t count)
+                        {
+                            for (size_t chunk; count > 0; offset += chunk, count -= chunk)
+                            {
+                                chunk = std::min< size_t >(count, 32);
+
+                                buffer.fill_span_masked (offset, chunk, pattern & (uint32_t(0xFFFFFFFF) >> (32 - chunk)), color);
+                            }
+                        }
+                    );
+                }
+            );
+        };
+
+        double masked_full_rate = masked (0xFFFFFFFF);
+        double masked_half_rate = masked (0x55555555);
+
+        double write_span_rate = measure
+        (
+            [&] ()
+            {
+                for_each_span (length, [&] (size_t offset, size_t count) { buffer.write_span (offset, count, colors.data () + offset % width); });
+            }
+        );
+
+        std::printf
+        (
+            "%-9s %6zu %10.0f %10.0f %10.0f %10.0f %10.0f %7.1fx\n",
+            format, length, set_pixel_rate, fill_span_rate, masked_full_rate, masked_half_rate, write_span_rate,
+            fill_span_rate / set_pixel_rate
+        );
+    }
+
+}
+
+int main ()
+{
+    static const size_t lengths[] = { 1, 4, 16, 64, 256, width };
+
+    std::printf ("Millones de pixels por segundo escritos en spans de cada longitud (%zux%zu pixels)\n\n", width, height);
+    std::printf ("%-9s %6s %10s %10s %10s %10s %10s %8s\n", "formato", "span", "set_pixel", "fill_span", "masked", "masked/2", "write_span", "mejora");
+
+    for (size_t length : lengths) benchmark< Color_Buffer_Rgba8888 > ("rgba8888", length);
+    for (size_t length : lengths) benchmark< Color_Buffer_Rgb565   > ("rgb565"  , length);
+
+    return (EXIT_SUCCESS);
+}
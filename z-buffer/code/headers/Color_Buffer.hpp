@@ -12,22 +12,43 @@
 #ifndef COLOR_BUFFER_HEADER
 #define COLOR_BUFFER_HEADER
 
+    #include <cstddef>
+
+    // Headless builds leave out gl_draw_pixels() and never include nor call OpenGL (/D Z_BUFFER_HEADLESS=1):
+
+    #ifndef Z_BUFFER_HEADLESS
+        #define Z_BUFFER_HEADLESS 0
+    #endif
+
     namespace example
     {
 
         class Color_Buffer
         {
+        public:
+
+            // With the tiled layout the pixels are stored in tiles of tile_size x tile_size, one tile after
+            // the other from left to right and from top to bottom, and the rows of each tile one after the
+            // other. A tall and thin triangle touches then a cache line every tile_size scanlines instead of
+            // one per scanline:
+
+            static const size_t tile_size = 8;
+
         protected:
 
             size_t width;
             size_t height;
+            bool   tiled;
+            size_t tiles_per_row;
 
         public:
 
-            Color_Buffer(size_t width, size_t height)
+            Color_Buffer(size_t width, size_t height, bool tiled = false)
             :
                 width (width ),
-                height(height)
+                height(height),
+                tiled (tiled ),
+                tiles_per_row((width + tile_size - 1) / tile_size)
             {
             }
 
@@ -43,9 +64,25 @@
                 return (height);
             }
 
-            int offset_at (int x, int y) const
+            bool is_tiled () const
             {
-                return (y * width + x);
+                return (tiled);
+            }
+
+            // Number of pixels to allocate. The tiled layout pads the last column and row of tiles:
+
+            size_t storage_size () const
+            {
+                if (!tiled) return (width * height);
+
+                return (tiles_per_row * ((height + tile_size - 1) / tile_size) * tile_size * tile_size);
+            }
+
+            size_t offset_at (size_t x, size_t y) const
+            {
+                if (!tiled) return (y * width + x);
+
+                return (((y / tile_size) * tiles_per_row + x / tile_size) * tile_size * tile_size + (y % tile_size) * tile_size + x % tile_size);
             }
 
         public:
@@ -54,7 +91,10 @@
             virtual void set_color      (int r, int  g, int b) = 0;
             virtual void set_pixel      (int x, int  y) = 0;
             virtual void set_pixel      (size_t offset) = 0;
+
+        #if !Z_BUFFER_HEADLESS
             virtual void gl_draw_pixels (int raster_x, int raster_y) const = 0;
+        #endif
 
         };
 
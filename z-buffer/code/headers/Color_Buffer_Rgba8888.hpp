@@ -13,10 +13,14 @@
 #define COLOR_BUFFER_RGBA8888_HEADER
 
     #include "Color_Buffer.hpp"
-    #include <SFML/OpenGL.hpp>
     #include <stdint.h>             // This header is <csdint> on C++11...
+    #include <algorithm>
     #include <vector>
 
+    #if !Z_BUFFER_HEADLESS
+        #include <SFML/OpenGL.hpp>
+    #endif
+
     namespace example
     {
 
@@ -63,12 +67,14 @@
             Buffer buffer;
             Color  color;
 
+            mutable Buffer linear;              // Row-major copy of a tiled buffer for gl_draw_pixels()
+
         public:
 
-            Color_Buffer_Rgba8888(size_t width, size_t height)
+            Color_Buffer_Rgba8888(size_t width, size_t height, bool tiled = false)
             :
-                Color_Buffer(width,  height),
-                buffer      (width * height)
+                Color_Buffer(width,  height, tiled),
+                buffer      (storage_size ())
             {
             }
 
@@ -96,6 +102,11 @@
 
         public:
 
+            const Color & get_color () const
+            {
+                return (color);
+            }
+
             void set_color (int r, int g, int b)
             {
                 color.data.component.r = uint8_t(r < 0 ? 0 : r > 255 ? 255 : r);
@@ -116,19 +127,112 @@
 
             void set_pixel (int x, int y)
             {
-                buffer[y * width + x] = color;
+                buffer[offset_at (size_t(x), size_t(y))] = color;
+            }
+
+        public:
+
+            // Span operations. They are not virtual, so the rasterizer can inline them and the compiler
+            // can turn the loops into vector stores:
+
+            void fill_span (size_t offset, size_t count)
+            {
+                fill_span (offset, count, color);
+            }
+
+            void fill_span (size_t offset, size_t count, const Color & span_color)
+            {
+                uint32_t * target = &buffer[offset].data.value;
+                uint32_t   value  = span_color.data.value;
+                size_t     index  = 0;
+
+                // Blocks of 8 pixels have a fixed trip count, so they get vector stores even when the compiler
+                // would not vectorize the whole loop:
+
+                for ( ; index + 8 <= count; index += 8)
+                {
+                    for (size_t lane = 0; lane < 8; ++lane) target[index + lane] = value;
+                }
+
+                for ( ; index < count; ++index) target[index] = value;
+            }
+
+            // Writes span_color on the pixels whose bit is set in mask (count must not exceed 32). A full
+            // mask is written as a plain span:
+
+            void fill_span_masked (size_t offset, size_t count, uint32_t mask, const Color & span_color)
+            {
+                if (count == 32 ? mask == 0xFFFFFFFF : mask == (uint32_t(1) << count) - 1)
+                {
+                    fill_span (offset, count, span_color);
+                    return;
+                }
+
+                uint32_t * target = &buffer[offset].data.value;
+                uint32_t   value  = span_color.data.value;
+
+                for ( ; mask != 0; mask >>= 1, ++target)
+                {
+                    if (mask & 1) *target = value;
+                }
+            }
+
+            void write_span (size_t offset, size_t count, const Color * span_colors)
+            {
+                std::copy (span_colors, span_colors + count, buffer.begin () + offset);
+            }
+
+            // Exchanges the pixels with other, which must have the same size and layout. Only the storage is
+            // swapped, so a finished frame can be handed over without copying it:
+
+            void swap_pixels (Color_Buffer_Rgba8888 & other)
+            {
+                buffer.swap (other.buffer);
             }
 
+            // Copies the pixels to target (width * height colors) from left to right and from top to bottom,
+            // whatever the layout. Each row of a tile is copied at once:
+
+            void linearize (Color * target) const
+            {
+                if (!tiled)
+                {
+                    std::copy (buffer.begin (), buffer.begin () + width * height, target);
+                    return;
+                }
+
+                for (size_t y = 0; y < height; ++y, target += width)
+                {
+                    const Color * source = &buffer[offset_at (0, y)];
+
+                    for (size_t x = 0; x < width; x += tile_size, source += tile_size * tile_size)
+                    {
+                        std::copy (source, source + std::min (width - x, size_t(tile_size)), target + x);
+                    }
+                }
+            }
+
+        #if !Z_BUFFER_HEADLESS
+
             void gl_draw_pixels (int raster_x, int raster_y) const
             {
                 // glDrawPixels() is efficient when the driver has proper support. Otherwise it will be slow.
                 // Color buffer objects could be more appropriate, but glDrawPixels() is more simple and compatible
                 // within the context of this example.
 
+                if (tiled)
+                {
+                    linear.resize (width * height);
+
+                    linearize (&linear.front ());
+                }
+
                 glRasterPos2i (raster_x, raster_y);
-                glDrawPixels  (width, height, GL_RGBA, GL_UNSIGNED_BYTE, colors ());
+                glDrawPixels  (width, height, GL_RGBA, GL_UNSIGNED_BYTE, tiled ? &linear.front () : colors ());
             }
 
+        #endif
+
         };
 
     }
@@ -0,0 +1,139 @@
+/**
+ * @file Depth_Format.hpp
+ * @author Gonzalo Perez Chamarro
+ * @brief Formatos en los que el Rasterizer puede almacenar el z_buffer
+ * @version 0.1
+ * @date 2019-03-10
+ *
+ * @copyright Copyright (c) 2019
+ *
+ */
+
+#ifndef DEPTH_FORMAT_HEADER
+#define DEPTH_FORMAT_HEADER
+
+    #include <cmath>
+    #include <limits>
+    #include <stdint.h>
+
+    namespace example
+    {
+
+        /**
+         * @brief Todos los formatos reciben la Z de los vértices como un entero en [0, depth_max], donde 0
+         * es el plano cercano y depth_max el lejano. El Rasterizer interpola siempre ese entero y cada
+         * formato decide cómo se guarda. Las operaciones que debe ofrecer un formato son:
+         *
+         * - Stored: tipo de cada elemento del z_buffer.
+         * - far_value (): valor con el que se limpia el z_buffer.
+         * - store (z): valor que se guarda para la Z interpolada z.
+         * - passes (z, stored): true si z está más cerca que el valor guardado.
+         * - bound (stored): menor Z que no pasa el test contra stored (o una cota inferior de ella),
+         *   usada por la Z jerárquica.
+         *
+         */
+        static const int depth_max = 1 << 30;
+
+        /**
+         * @brief Convierte a entero la cota de la Z jerárquica de los formatos en coma flotante
+         *
+         */
+        inline int saturate_depth_bound (double limit)
+        {
+            if (limit >= double(std::numeric_limits< int >::max ())) return (std::numeric_limits< int >::max ());
+            if (limit <= double(std::numeric_limits< int >::min ())) return (std::numeric_limits< int >::min ());
+
+            return (int(limit));
+        }
+
+        /**
+         * @brief Z entera de 32 bits, tal cual se interpola
+         *
+         */
+        struct Depth_Int32
+        {
+            typedef int32_t Stored;
+
+            static Stored far_value    ()                     { return (std::numeric_limits< int32_t >::max ()); }
+            static Stored store        (int z)                { return (z); }
+            static bool   passes       (int z, Stored stored) { return (z < stored); }
+            static int    bound        (Stored stored)        { return (stored); }
+        };
+
+        /**
+         * @brief Z normalizada sin signo de BITS bits. Se conservan los bits altos de la Z interpolada y
+         * las Z fuera de [0, depth_max] se saturan.
+         *
+         */
+        template< typename STORED, int BITS >
+        struct Depth_Unorm
+        {
+            typedef STORED Stored;
+
+            enum
+            {
+                shift     = 30 - BITS,
+                max_value = (1 << BITS) - 1
+            };
+
+            static Stored far_value () { return (Stored(max_value)); }
+
+            static Stored store (int z)
+            {
+                return (Stored(z < 0 ? 0 : z >> shift > max_value ? max_value : z >> shift));
+            }
+
+            static bool passes (int z, Stored stored)
+            {
+                return (store (z) < stored);
+            }
+
+            static int bound (Stored stored)
+            {
+                return (int(stored) << shift);
+            }
+        };
+
+        /**
+         * @brief 16 bits: la mitad de tráfico de memoria que Depth_Int32
+         *
+         */
+        typedef Depth_Unorm< uint16_t, 16 > Depth_Unorm16;
+
+        /**
+         * @brief 24 bits en palabras de 32, con los 8 bits altos libres (como un D24X8)
+         *
+         */
+        typedef Depth_Unorm< uint32_t, 24 > Depth_Unorm24;
+
+        /**
+         * @brief Z en coma flotante en [0, 1]. Como la Z de la proyección se acumula cerca de 1, allí
+         * solo conserva 24 bits de precisión. Guardarla invertida no la haría más precisa que
+         * Depth_Int32, porque la Z llega ya interpolada como entero.
+         *
+         */
+        struct Depth_Float32
+        {
+            typedef float Stored;
+
+            static Stored far_value () { return (std::numeric_limits< float >::max ()); }
+
+            static Stored store (int z)
+            {
+                return (float(z) * (1.f / depth_max));
+            }
+
+            static bool passes (int z, Stored stored)
+            {
+                return (store (z) < stored);
+            }
+
+            static int bound (Stored stored)
+            {
+                return (saturate_depth_bound (std::ceil (double(stored) * depth_max)));
+            }
+        };
+
+    }
+
+#endif
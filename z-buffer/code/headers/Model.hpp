@@ -14,8 +14,11 @@
 
 #include "Color_Buffer_Rgba8888.hpp"
 #include "Rasterizer.hpp"
+#include "Occlusion_Buffer.hpp"
+#include "Radix_Sort.hpp"
 #include <Projection.hpp> 
 #include <string>
+#include <cmath>
 #include <vector>
 #include <map>
 
@@ -38,6 +41,18 @@ namespace example
 	class Model
 	{
 	private:
+/**
+ * @brief Maximo de vertices de un triangulo recortado por los planos cercano y lejano y por los
+ * cuatro lados de un rectangulo
+ * 
+ */
+		static const int max_clipped_vertices = 9;
+/**
+ * @brief Triangulos consecutivos de cada grupo que se ordena de delante a atras
+ * 
+ */
+		static const int cluster_triangles = 64;
+
 		typedef Color_Buffer_Rgba8888 Color_Buffer;
 		typedef Color_Buffer_Rgba8888::Color Color;
 
@@ -53,12 +68,43 @@ namespace example
 		typedef Rotation3f Rotation;
 		typedef Scaling3f Scale;
 
+/**
+ * @brief Rectangulo en pantalla y Z mas cercana de una caja envolvente proyectada
+ * 
+ */
+		struct Screen_Box
+		{
+			float x_min, y_min, x_max, y_max, z_min;
+		};
+
+/**
+ * @brief Resultado de un update: todo lo que leen del modelo paint, resolve_occlusion y
+ * shade_triangle. Hay dos, de modo que se puede actualizar un frame en un hilo mientras se pinta
+ * el anterior en otro.
+ * 
+ */
+		struct Frame
+		{
+			Transform              transform;             // Proyeccion por transform del modelo
+			Vertex_Buffer          transformed_vertices;  // Despues de dividir por w
+			Vertex_Buffer          clip_space_vertices;   // Antes de dividir por w
+			Vertex_Buffer          transformed_normals;
+			Vertex_Colors          transformed_colors;    // Sin calcular si deferred_lighting
+			std::shared_ptr<Light> light;
+			float                  ambiental_intensity;
+			bool                   deferred_lighting;
+			bool                   skipped;               // Oculto o descartado en update: sin vertices
+		};
+
 	private:
-	/**
-	 * @brief Matriz de transformacion
-	 * 
-	 */
-		Transform transform;
+/**
+ * @brief Frames que escriben los update y que leen los paint. Son el mismo salvo que se pinte
+ * un frame mientras se actualiza el siguiente (ver advance_frame).
+ * 
+ */
+		Frame frames[2];
+		size_t update_frame;
+		size_t paint_frame;
 
 		/**
 		 * @brief Transform del padre
@@ -130,28 +176,18 @@ namespace example
  */
 		Vertex_Colors     original_colors;
 /**
- * @brief Array de colores ya transformados con la luz
+ * @brief Vertices en coordenadas de pantalla de los poligonos recortados por los planos cercano
+ * y lejano en el frame actual
  * 
  */
-		Vertex_Colors	transformed_colors;
+		Vertex_Buffer   clipped_vertices;
 
 /**
- * @brief Buffer de vertices transformados
+ * @brief Buffer de vertices en coordenadas de pantalla
  * 
  */
-		Vertex_Buffer   transformed_vertices;
+		Vertex_Buffer   screen_vertices;
 
-/**
- * @brief Buffer de normales transformadas
- * 
- */
-		Vertex_Buffer	transformed_normals;
-
-/**
- * @brief Vector de vertices a pintar
- * 
- */
-		vector< Point4i > display_vertices;
 /**
  * @brief indice en orden de vertices
  * 
@@ -177,6 +213,79 @@ namespace example
  * 
  */
 		float rotation_speed;
+/**
+ * @brief Indice del modelo en los identificadores de primitiva del visibility buffer
+ * 
+ */
+		uint32_t model_index;
+/**
+ * @brief Si se recortan tambien los triangulos que cruzan el plano lejano
+ * 
+ */
+		bool far_clipping;
+/**
+ * @brief Esquinas de la caja envolvente del modelo en coordenadas locales
+ * 
+ */
+		Vertex bounding_box[8];
+/**
+ * @brief Si ningun pixel del modelo paso el test de profundidad en el frame anterior. Mientras lo
+ * este, no se transforman ni se pintan sus vertices y solo se prueba su caja envolvente.
+ * 
+ */
+		bool occluded;
+/**
+ * @brief Si update_vertices se salta el modelo por estar oculto. Es una copia de occluded tomada
+ * en advance_frame, para que resolve_occlusion pueda escribir occluded mientras otro hilo actualiza
+ * el frame siguiente. En ese caso el update aun no conoce el resultado del paint con el que se
+ * solapa y usa el del anterior: el resultado del paint N decide el update N+2 en lugar del N+1, y
+ * un modelo que deja de estar tapado tarda un frame mas en volver a pintarse.
+ * 
+ */
+		bool update_occluded;
+/**
+ * @brief Si ademas estan ocultos todos sus descendientes, en cuyo caso se prueba una sola caja
+ * que los envuelve a todos
+ * 
+ */
+		bool subtree_occluded;
+/**
+ * @brief Si el modelo queda detras de los oclusores en el frame actual, en cuyo caso tampoco se
+ * transforman ni se pintan sus vertices
+ * 
+ */
+		bool culled;
+/**
+ * @brief Si el modelo se pinta en el buffer de oclusion para descartar a los demas
+ * 
+ */
+		bool occluder;
+/**
+ * @brief Centro en coordenadas locales de la caja envolvente de cada grupo de cluster_triangles
+ * triangulos consecutivos
+ * 
+ */
+		Vertex_Buffer cluster_centers;
+/**
+ * @brief Si los grupos de triangulos se pintan de delante a atras
+ * 
+ */
+		bool cluster_sorting;
+/**
+ * @brief Orden en el que se pintan los grupos en el frame actual y buffer auxiliar de la ordenacion
+ * 
+ */
+		vector<Sort_Entry> cluster_order;
+		vector<Sort_Entry> sort_scratch;
+/**
+ * @brief Triangulos del frame actual que se envian juntos al rasterizador: vertices en su formato,
+ * tres indices por triangulo y el color o el identificador de primitiva de cada uno
+ * 
+ */
+		vector<Point4i>   batch_vertices;
+		Index_Buffer      batch_indices;
+		Vertex_Colors     batch_colors;
+		vector<uint32_t>  batch_ids;
 
 
 	public:
@@ -201,14 +310,122 @@ namespace example
  * @param projection Proyeccion
  * @param light Luz de la escena
  * @param ambiental_intensity Intensidad ambiental de la escena
+ * @param deferred_lighting Si es true no se iluminan los vertices, sino que se ilumina cada
+ * triangulo visible con shade_triangle (modo visibility buffer)
+ */
+		void update(Projection3f * projection, std::shared_ptr<Light> light, float ambiental_intensity, bool deferred_lighting = false)
+		{
+			update_transform(projection);
+			update_vertices(light, ambiental_intensity, deferred_lighting);
+		}
+/**
+ * @brief Primera parte de update: avanza la rotacion y recalcula los transforms del modelo y de sus
+ * hijos, sin tocar los vertices
+ * 
+ * @param projection Proyeccion
+ */
+		void update_transform(Projection3f * projection);
+/**
+ * @brief Segunda parte de update: transforma e ilumina los vertices, salvo que el modelo este oculto
+ * 
+ * @param light Luz de la escena
+ * @param ambiental_intensity Intensidad ambiental de la escena
+ * @param deferred_lighting Si es true no se iluminan los vertices (modo visibility buffer)
+ */
+		void update_vertices(std::shared_ptr<Light> light, float ambiental_intensity, bool deferred_lighting = false);
+/**
+ * @brief Pasa a paint el frame del ultimo update. Con double_buffered el siguiente update escribe
+ * en el otro frame, por lo que puede ejecutarse mientras se pinta este. No puede llamarse mientras
+ * se actualiza o se pinta.
+ * 
+ * @param double_buffered 
+ */
+		void advance_frame(bool double_buffered)
+		{
+			paint_frame = update_frame;
+
+			if (double_buffered) update_frame ^= 1;
+
+			update_occluded = occluded;
+		}
+/**
+ * @brief Metodo de pintado del modelo. En el modo visibility buffer cada triangulo se envia
+ * con su identificador de primitiva en lugar de con su color.
+ * 
+ * @param rasterizer 
+ * @param depth_only Si es true solo se escribe la Z (pasada previa de profundidad)
  */
-		void update(Projection3f * projection, std::shared_ptr<Light> light, float ambiental_intensity);
+		void paint(Rasterizer<Color_Buffer> * rasterizer, bool depth_only = false);
 /**
- * @brief Metodo de pintado del modelo
+ * @brief Decide que modelos de la jerarquia se saltan en el siguiente frame, a partir de la consulta
+ * de oclusion de cada modelo pintado y probando contra el z_buffer la caja envolvente de los que no
+ * se han pintado. Se llama sobre los modelos raiz despues de pintar todos los modelos. Como la
+ * consulta cuenta los pixels que pasan el test al pintar, solo detecta los modelos tapados por otros
+ * pintados antes, o por cualquiera con la pasada previa de profundidad.
  * 
  * @param rasterizer 
+ * @return true Si se ve el modelo o alguno de sus descendientes
  */
-		void paint(Rasterizer<Color_Buffer> * rasterizer);
+		bool resolve_occlusion(Rasterizer<Color_Buffer> * rasterizer);
+/**
+ * @brief Vuelve a pintar el modelo en todos los frames
+ * 
+ */
+		void reset_occlusion()
+		{
+			occluded = false;
+			update_occluded = false;
+			subtree_occluded = false;
+		}
+
+		bool is_occluded() const { return occluded; }
+/**
+ * @brief Si se pinta el modelo en el frame actual: no esta oculto ni se lo salto el update
+ * 
+ * @return true 
+ * @return false 
+ */
+		bool is_painted() const { return !occluded && !frames[paint_frame].skipped; }
+/**
+ * @brief Pinta en el buffer de oclusion los triangulos del modelo que miran a camara. Se llama
+ * despues de update_vertices.
+ * 
+ * @param buffer 
+ */
+		void render_occluder(Occlusion_Buffer & buffer);
+/**
+ * @brief Comprueba si la caja envolvente del modelo queda por completo detras de los oclusores
+ * 
+ * @param buffer 
+ * @return true 
+ * @return false 
+ */
+		bool is_hidden_by(const Occlusion_Buffer & buffer) const
+		{
+			return !is_box_visible(buffer, buffer.get_width(), buffer.get_height(), false, update_frame);
+		}
+/**
+ * @brief Marca el modelo como descartado por los oclusores en el frame actual
+ * 
+ * @param hidden 
+ */
+		void set_culled(bool hidden) { culled = hidden; }
+
+		bool is_culled() const { return culled; }
+
+		void set_occluder(bool enabled) { occluder = enabled; }
+
+		bool is_occluder() const { return occluder; }
+/**
+ * @brief Devuelve el color iluminado de un triangulo del modelo
+ * 
+ * @param triangle Indice del triangulo
+ * @return Color 
+ */
+		Color shade_triangle(uint32_t triangle) const
+		{
+			return light_vertex(frames[paint_frame], size_t(triangle) * 3);
+		}
 
 /**
  * @brief (Antiguo) Metodo que comprueba si el poligono mira a camara
@@ -244,6 +461,12 @@ namespace example
  * @return const string& 
  */
 		const string & get_name() const { return name; }
+/**
+ * @brief Devuelve el error de la carga del obj, o una cadena vacia si se cargo bien
+ * 
+ * @return const string& 
+ */
+		const string & get_error_message() const { return error_message; }
 /**
  * @brief Ajusta el transform del padre
  * 
@@ -254,13 +477,13 @@ namespace example
 			global_tr = tr;
 		}
 /**
- * @brief Devuelve el transform del modelo
+ * @brief Devuelve el transform del modelo del ultimo update
  * 
  * @return Transform 
  */
 		Transform get_transform() const
 		{
-			return transform;
+			return frames[update_frame].transform;
 		}
 /**
  * @brief Ajusta la velocidad de rotacion en y
@@ -268,13 +491,135 @@ namespace example
  * @param speed 
  */
 		void set_rotation_speed_y(float speed) { rotation_speed = speed; }
+/**
+ * @brief Ajusta el indice del modelo en los identificadores de primitiva
+ * 
+ * @param index 
+ */
+		void set_model_index(uint32_t index) { model_index = index; }
+/**
+ * @brief Activa el recorte con el plano lejano (el cercano siempre se recorta)
+ * 
+ * @param enabled 
+ */
+		void set_far_clipping(bool enabled) { far_clipping = enabled; }
+/**
+ * @brief Activa la ordenacion de delante a atras de los grupos de triangulos del modelo, con la que
+ * los pixels tapados por el propio modelo fallan antes el test de profundidad
+ * 
+ * @param enabled 
+ */
+		void set_cluster_sorting(bool enabled) { cluster_sorting = enabled; }
+
+		bool get_cluster_sorting() const { return cluster_sorting; }
+/**
+ * @brief Devuelve la distancia a la camara (la W de recorte) del centro de la caja envolvente del
+ * modelo, con los transforms del frame que se pinta
+ * 
+ * @return float 
+ */
+		float get_view_depth() const
+		{
+			Vertex center = bounding_box[0];
+
+			for (int i = 0; i < 3; ++i) center[i] = (bounding_box[0][i] + bounding_box[7][i]) * 0.5f;
+
+			return get_clip_w(center);
+		}
 
 	private:
+/**
+ * @brief W de recorte de un punto en coordenadas locales, sin transformar el resto de componentes
+ * 
+ * @param point 
+ * @return float 
+ */
+		float get_clip_w(const Vertex & point) const
+		{
+			const Matrix44f & matrix = frames[paint_frame].transform;
+
+			return matrix[3][0] * point[0] + matrix[3][1] * point[1] + matrix[3][2] * point[2] + matrix[3][3] * point[3];
+		}
+/**
+ * @brief Calcula en cluster_order el orden en el que se pintan los grupos de triangulos: de delante
+ * a atras si esta activo cluster_sorting y en el orden del obj si no
+ * 
+ */
+		void sort_clusters();
 /**
  * @brief Envia el transform del modelo a todos sus hijos
  * 
  */
 		void refresh_children_transform();
+/**
+ * @brief Transform de coordenadas normalizadas a coordenadas de pantalla, con la Z en [0, depth_max]
+ * 
+ * @param rasterizer 
+ * @return Transformation3f 
+ */
+		static Transformation3f get_viewport_transform(size_t width, size_t height);
+/**
+ * @brief Comprueba si podria verse alguna parte de la caja envolvente del modelo en un Rasterizer
+ * o en un Occlusion_Buffer
+ * 
+ * @param depth_buffer 
+ * @param width Ancho de la pantalla
+ * @param height Alto de la pantalla
+ * @param include_children Si la caja envuelve tambien a todos los descendientes
+ * @param frame Frame con cuyo transform se proyecta la caja
+ * @return true 
+ * @return false 
+ */
+		template< class DEPTH_BUFFER >
+		bool is_box_visible(DEPTH_BUFFER & depth_buffer, size_t width, size_t height, bool include_children, size_t frame) const
+		{
+			const float limit = float(Rasterizer<Color_Buffer>::guard_band_limit);
+
+			Screen_Box box = { limit, limit, -limit, -limit, float(depth_max) };
+
+			//Una caja que cruza el plano cercano se considera visible
+			if (!add_to_screen_box(get_viewport_transform(width, height), box, include_children, frame)) return true;
+
+			//Se prueban los pixels que toca el rectangulo con la Z mas cercana de la caja
+			return depth_buffer.is_rectangle_visible
+			(
+				int(std::floor(std::max(box.x_min, -limit))),
+				int(std::floor(std::max(box.y_min, -limit))),
+				int(std::floor(std::min(box.x_max, limit))),
+				int(std::floor(std::min(box.y_max, limit))),
+				int(std::floor(std::max(box.z_min, 0.f)))
+			);
+		}
+/**
+ * @brief Amplia box con la proyeccion de la caja envolvente del modelo
+ * 
+ * @param viewport 
+ * @param box 
+ * @param include_children 
+ * @param frame 
+ * @return false Si la caja cruza el plano cercano, en cuyo caso no se puede proyectar
+ */
+		bool add_to_screen_box(const Transformation3f & viewport, Screen_Box & box, bool include_children, size_t frame) const;
+/**
+ * @brief Calcula el color de un vertice con la luz con la que se actualizo un frame
+ * 
+ * @param frame 
+ * @param index Indice del vertice
+ * @return Color 
+ */
+		Color light_vertex(const Frame & frame, size_t index) const;
+/**
+ * @brief Descarta o recorta con la banda de guarda un poligono en coordenadas de pantalla y
+ * lo añade al lote de triangulos (en abanico si tiene mas de tres vertices)
+ * 
+ * @param rasterizer 
+ * @param vertices Vertices en coordenadas de pantalla
+ * @param first_index 
+ * @param last_index 
+ * @param triangle Triangulo del modelo del que procede el poligono
+ * @param depth_only 
+ */
+		void batch_polygon(Rasterizer<Color_Buffer> * rasterizer, const Vertex * vertices, const int * first_index, const int * last_index, size_t triangle, bool depth_only);
 /**
  * @brief Devuelve el modulo de un vector
  * 
@@ -291,7 +636,7 @@ namespace example
  * @param vector 
  * @return Vector3f 
  */
-		Vector3f normalize_vector(Vector3f vector)
+		Vector3f normalize_vector(Vector3f vector) const
 		{
 			float module = get_vector_module(vector);
 			return Vector3f({ vector[0] / module, vector[1] / module, vector[2] / module});
@@ -303,13 +648,84 @@ namespace example
  * @param n 
  * @return float 
  */
-		float dot(Vector3f m, Vector3f n)
+		float dot(Vector3f m, Vector3f n) const
 		{
 			return m[0] * n[0] + m[1] * n[1] + m[2] * n[2];
 		}
 
-		int clip_with_viewport_2d(const Point4f * vertices, const int * first_index, const int * last_index, Point4f * clipped_vertices);
+/**
+ * @brief Comprueba si un vertice en coordenadas de pantalla queda dentro de la banda de guarda
+ * 
+ * @param vertex 
+ * @param guard_band Limite de las coordenadas X e Y
+ * @return true 
+ * @return false 
+ */
+		bool is_inside_guard_band(const Vertex & vertex, float guard_band) const
+		{
+			return std::abs(vertex[0]) <= guard_band && std::abs(vertex[1]) <= guard_band;
+		}
+/**
+ * @brief Convierte un vertice en coordenadas de pantalla al formato del rasterizador, redondeando
+ * X e Y a la rejilla de subpixels
+ * 
+ * @param vertex 
+ * @return Point4i 
+ */
+		static Point4i snap_vertex(const Vertex & vertex)
+		{
+			const float subpixel_size = float(Rasterizer<Color_Buffer>::subpixel_size);
+
+			Point4i snapped = Point4i(vertex);
 
+			snapped[0] = int(std::floor(vertex[0] * subpixel_size + 0.5f));
+			snapped[1] = int(std::floor(vertex[1] * subpixel_size + 0.5f));
+
+			return snapped;
+		}
+/**
+ * @brief Recorta un poligono convexo con el rectangulo [x_min, x_max] x [y_min, y_max]
+ * 
+ * @param vertices 
+ * @param first_index 
+ * @param last_index 
+ * @param clipped_vertices Vertices del poligono recortado (como maximo max_clipped_vertices)
+ * @return int Numero de vertices del poligono recortado
+ */
+		int clip_with_viewport_2d
+		(
+			const Point4f * vertices,
+			const int      * first_index,
+			const int      * last_index,
+			Point4f * clipped_vertices,
+			float      x_min,
+			float      y_min,
+			float      x_max,
+			float      y_max
+		);
+/**
+ * @brief Recorta un poligono convexo en coordenadas homogeneas con el plano
+ * a * x + b * y + c * z + d * w = 0, conservando la parte en la que es >= 0
+ * 
+ * @return int Numero de vertices del poligono recortado
+ */
+		int clip_with_plane_3d
+		(
+			const Point4f * vertices,
+			const int      * first_index,
+			const int      * last_index,
+			Point4f * clipped_vertices,
+			float      a,
+			float      b,
+			float      c,
+			float      d
+		);
+/**
+ * @brief Recorta un poligono convexo con la recta a * x + b * y + c = 0, conservando la parte
+ * en la que a * x + b * y + c >= 0
+ * 
+ * @return int Numero de vertices del poligono recortado
+ */
 		int clip_with_line_2d
 		(
 			const Point4f * vertices,
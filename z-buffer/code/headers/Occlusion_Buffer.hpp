@@ -0,0 +1,329 @@
+/**
+ * @file Occlusion_Buffer.hpp
+ * @author Gonzalo Perez Chamarro
+ * @brief Z de baja resolución de los oclusores, con la que se descartan modelos enteros antes de transformarlos
+ * @version 0.1
+ * @date 2019-03-10
+ *
+ * @copyright Copyright (c) 2019
+ *
+ */
+
+#ifndef OCCLUSION_BUFFER_HEADER
+#define OCCLUSION_BUFFER_HEADER
+
+    #include <vector>
+    #include <limits>
+    #include <stdint.h>
+    #include <Point.hpp>
+    #include <algorithm>
+    #include <cmath>
+    #include "Simd.hpp"
+
+    namespace example
+    {
+
+        using toolkit::Point4f;
+
+        /**
+         * @brief Buffer de oclusión al estilo de masked occlusion culling. Cada pixel del buffer cubre
+         * scale x scale pixels de la pantalla y se agrupan en tiles de tile_columns x tile_rows, que no
+         * guardan una Z por pixel sino dos capas:
+         *
+         * - z_reference: cota superior de la Z de todo el tile.
+         * - z_working y mask: cota superior de la Z de los pixels de mask, que son los cubiertos por
+         *   los triángulos que aún no cubren el tile entero. Cuando mask se completa, z_working pasa a
+         *   ser la nueva z_reference.
+         *
+         * Un pixel del buffer solo se da por cubierto si el triángulo lo cubre entero, 8 pixels a la vez,
+         * y la Z de cada triángulo se redondea hacia el lado lejano, por lo que un rectángulo que no pasa
+         * is_rectangle_visible() queda oculto en la pantalla.
+         *
+         */
+        class Occlusion_Buffer
+        {
+        public:
+
+            /**
+             * @brief Pixels de la pantalla por pixel del buffer en cada eje
+             *
+             */
+            static const int scale = 4;
+
+            /**
+             * @brief Tamaño de los tiles: una fila de 8 pixels por cada uno de los bits de un byte de mask
+             *
+             */
+            static const int tile_columns = 8;
+            static const int tile_rows    = 4;
+
+            /**
+             * @brief Los vértices se pasan a coma fija con subpixel_size subdivisiones por pixel del
+             * buffer. Los triángulos con algún vértice a más de guard_band_limit pixels del buffer no se
+             * pintan, de modo que las funciones de arista siempre caben en 32 bits.
+             *
+             */
+            static const int subpixel_bits    = 4;
+            static const int subpixel_size    = 1 << subpixel_bits;
+            static const int guard_band_limit = 512;
+
+        private:
+
+            struct Tile
+            {
+                int      z_reference;
+                int      z_working;
+                uint32_t mask;
+            };
+
+            size_t             width;
+            size_t             height;
+            int                columns;
+            int                rows;
+            int                tiles_per_row;
+            std::vector< Tile > tiles;
+
+        public:
+
+            Occlusion_Buffer(size_t width, size_t height)
+            :
+                width  (width ),
+                height (height),
+                columns(int(width  + scale - 1) / scale),
+                rows   (int(height + scale - 1) / scale),
+                tiles_per_row((columns + tile_columns - 1) / tile_columns)
+            {
+                tiles.resize (size_t(tiles_per_row) * ((rows + tile_rows - 1) / tile_rows));
+
+                clear ();
+            }
+
+            size_t get_width () const
+            {
+                return (width);
+            }
+
+            size_t get_height () const
+            {
+                return (height);
+            }
+
+            void clear ()
+            {
+                Tile empty;
+
+                empty.z_reference = std::numeric_limits< int >::max ();
+                empty.z_working   = 0;
+                empty.mask        = 0;
+
+                std::fill (tiles.begin (), tiles.end (), empty);
+            }
+
+/**
+ * @brief Pinta un triángulo de un oclusor, con X e Y en pixels de la pantalla y la Z en [0, depth_max]
+ * (como los vértices que recibe el Rasterizer antes de pasarlos a subpixels). Se pintan las dos caras.
+ *
+ */
+            void render_triangle (const Point4f & v0, const Point4f & v1, const Point4f & v2);
+
+/**
+ * @brief Comprueba si algún pixel de la pantalla del rectángulo [x_min, x_max] x [y_min, y_max] podría
+ * verse con la Z z. Si devuelve false, el rectángulo queda detrás de los oclusores.
+ *
+ */
+            bool is_rectangle_visible (int x_min, int y_min, int x_max, int y_max, int z) const
+            {
+                x_min = std::max (x_min, 0);
+                y_min = std::max (y_min, 0);
+                x_max = std::min (x_max, int(width ) - 1);
+                y_max = std::min (y_max, int(height) - 1);
+
+                if (x_min > x_max || y_min > y_max) return (false);
+
+                for (int row = y_min / scale / tile_rows; row <= y_max / scale / tile_rows; ++row)
+                {
+                    for (int column = x_min / scale / tile_columns; column <= x_max / scale / tile_columns; ++column)
+                    {
+                        if (z < tiles[row * tiles_per_row + column].z_reference) return (true);
+                    }
+                }
+
+                return (false);
+            }
+
+        private:
+
+            /**
+             * @brief Bits de mask de los pixels del tile que quedan fuera del buffer, que se dan por
+             * cubiertos al comprobar si el tile está completo
+             *
+             */
+            uint32_t outside_mask (int tile_x, int tile_y) const
+            {
+                int      inside_columns = std::min (columns - tile_x * tile_columns, int(tile_columns));
+                int      inside_rows    = std::min (rows    - tile_y * tile_rows   , int(tile_rows   ));
+                uint32_t row_mask       = uint32_t(0xFF) >> (tile_columns - inside_columns);
+                uint32_t mask           = 0;
+
+                for (int row = 0; row < inside_rows; ++row) mask |= row_mask << (row * tile_columns);
+
+                return (~mask);
+            }
+
+            /**
+             * @brief Añade a la capa de trabajo del tile los pixels de coverage, con z como cota de su Z
+             *
+             */
+            void merge_tile (int tile_x, int tile_y, uint32_t coverage, int z)
+            {
+                Tile & tile = tiles[tile_y * tiles_per_row + tile_x];
+
+                // Lo que queda detrás de la capa de referencia no la puede mejorar:
+
+                if (z >= tile.z_reference) return;
+
+                tile.z_working = std::max (tile.z_working, z);
+                tile.mask     |= coverage;
+
+                if ((tile.mask | outside_mask (tile_x, tile_y)) == 0xFFFFFFFF)
+                {
+                    tile.z_reference = tile.z_working;
+                    tile.z_working   = 0;
+                    tile.mask        = 0;
+                }
+            }
+
+        };
+
+        inline void Occlusion_Buffer::render_triangle (const Point4f & v0, const Point4f & v1, const Point4f & v2)
+        {
+            // Se pasan X e Y a subpixels del buffer, descartando los triángulos que se salen de la banda
+            // de guarda (dejar de pintar un oclusor nunca oculta nada de más):
+
+            const Point4f * source[3] = { &v0, &v1, &v2 };
+            const float     to_fixed  = float(subpixel_size) / scale;
+            const float     limit     = float(guard_band_limit * subpixel_size);
+
+            int   x[3], y[3];
+            float z_far = 0.f;
+
+            for (int i = 0; i < 3; ++i)
+            {
+                float fx = (*source[i])[0] * to_fixed;
+                float fy = (*source[i])[1] * to_fixed;
+
+                if (!(std::abs (fx) <= limit && std::abs (fy) <= limit)) return;
+
+                x[i]  = int(std::floor (fx + 0.5f));
+                y[i]  = int(std::floor (fy + 0.5f));
+                z_far = std::max (z_far, (*source[i])[2]);
+            }
+
+            // Se ordenan los vértices para que el área sea positiva:
+
+            int64_t area = int64_t(x[1] - x[0]) * (y[2] - y[0]) - int64_t(x[2] - x[0]) * (y[1] - y[0]);
+
+            if (area == 0) return;
+
+            int order[3] = { 0, 1, 2 };
+
+            if (area < 0)
+            {
+                std::swap (order[1], order[2]);
+                area = -area;
+            }
+
+            // Pixels del buffer cuyo centro queda en el rectángulo envolvente:
+
+            int x_min = std::max (int((int64_t(std::min ({ x[0], x[1], x[2] })) + subpixel_size / 2 - 1) >> subpixel_bits), 0);
+            int x_max = std::min (int((int64_t(std::max ({ x[0], x[1], x[2] })) - subpixel_size / 2    ) >> subpixel_bits), columns - 1);
+            int y_min = std::max (int((int64_t(std::min ({ y[0], y[1], y[2] })) + subpixel_size / 2 - 1) >> subpixel_bits), 0);
+            int y_max = std::min (int((int64_t(std::max ({ y[0], y[1], y[2] })) - subpixel_size / 2    ) >> subpixel_bits), rows    - 1);
+
+            if (x_min > x_max || y_min > y_max) return;
+
+            // Funciones de arista, positivas en el interior, como en Rasterizer::rasterize_triangle_half_space().
+            // Se evalúan en el centro de cada pixel menos inset, que es lo que baja la función desde el
+            // centro hasta la esquina menos favorable del pixel. Así un pixel solo cuenta como cubierto si
+            // sus cuatro esquinas quedan dentro del triángulo:
+
+            int64_t a_step[3], b_step[3], ax[3], ay[3], inset[3];
+            Int32x8 x_ramp[3];
+            Int32x8 y_steps[3];
+
+            for (int i = 0; i < 3; ++i)
+            {
+                int a = order[i], b = order[(i + 1) % 3];
+
+                a_step[i] = int64_t(y[a]) - y[b];
+                b_step[i] = int64_t(x[b]) - x[a];
+                ax    [i] = x[a];
+                ay    [i] = y[a];
+                inset [i] = (std::abs (a_step[i]) + std::abs (b_step[i])) * (subpixel_size / 2);
+
+                int s = int(a_step[i] * subpixel_size);
+
+                x_ramp [i] = Int32x8::set (0, s, 2 * s, 3 * s, 4 * s, 5 * s, 6 * s, 7 * s);
+                y_steps[i] = Int32x8::broadcast (int(b_step[i] * subpixel_size));
+            }
+
+            // Plano de profundidad en pixels del buffer. La Z de cada tile es la de la esquina más lejana
+            // de su contorno (los pixels cubiertos lo están hasta el borde), limitada a la del vértice más
+            // lejano:
+
+            double z0   = (*source[order[0]])[2];
+            double dz1  = double((*source[order[1]])[2]) - z0, dz2 = double((*source[order[2]])[2]) - z0;
+            double dx1  = x[order[1]] - x[order[0]], dy1 = y[order[1]] - y[order[0]];
+            double dx2  = x[order[2]] - x[order[0]], dy2 = y[order[2]] - y[order[0]];
+            double z_dx = (dz1 * dy2 - dz2 * dy1) / double(area) * subpixel_size;
+            double z_dy = (dz2 * dx1 - dz1 * dx2) / double(area) * subpixel_size;
+            double px0  = double(x[order[0]]) / subpixel_size - 0.5;
+            double py0  = double(y[order[0]]) / subpixel_size - 0.5;
+            double z_max_limit = std::min (double(z_far), double(std::numeric_limits< int >::max () - 1));
+
+            Int32x8 minus1 = Int32x8::broadcast (-1);
+
+            for (int tile_y = y_min / tile_rows; tile_y <= y_max / tile_rows; ++tile_y)
+            {
+                int py = tile_y * tile_rows;
+
+                for (int tile_x = x_min / tile_columns; tile_x <= x_max / tile_columns; ++tile_x)
+                {
+                    int px = tile_x * tile_columns;
+
+                    Int32x8 e[3];
+
+                    for (int i = 0; i < 3; ++i)
+                    {
+                        int64_t origin = a_step[i] * (int64_t(px) * subpixel_size + subpixel_size / 2 - ax[i])
+                                       + b_step[i] * (int64_t(py) * subpixel_size + subpixel_size / 2 - ay[i])
+                                       - inset[i];
+
+                        e[i] = Int32x8::broadcast (int(origin)) + x_ramp[i];
+                    }
+
+                    uint32_t coverage = 0;
+
+                    for (int row = 0; row < tile_rows; ++row)
+                    {
+                        coverage |= uint32_t(greater (e[0] | e[1] | e[2], minus1).mask ()) << (row * tile_columns);
+
+                        e[0] = e[0] + y_steps[0];
+                        e[1] = e[1] + y_steps[1];
+                        e[2] = e[2] + y_steps[2];
+                    }
+
+                    if (coverage == 0) continue;
+
+                    double z = z0 + z_dx * (px - 0.5 - px0) + z_dy * (py - 0.5 - py0)
+                             + std::max (z_dx * tile_columns, 0.0)
+                             + std::max (z_dy * tile_rows   , 0.0);
+
+                    merge_tile (tile_x, tile_y, coverage, int(std::ceil (std::min (z, z_max_limit))));
+                }
+            }
+        }
+
+    }
+
+#endif
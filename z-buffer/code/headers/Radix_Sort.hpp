@@ -0,0 +1,97 @@
+/**
+ * @file Radix_Sort.hpp
+ * @author Gonzalo Perez Chamarro
+ * @brief Ordenación por radix de claves de profundidad cuantizadas de 16 bits
+ * @version 0.1
+ * @date 2019-03-10
+ *
+ * @copyright Copyright (c) 2019
+ *
+ */
+
+#ifndef RADIX_SORT_HEADER
+#define RADIX_SORT_HEADER
+
+    #include <vector>
+    #include <cstring>
+    #include <stdint.h>
+
+    namespace example
+    {
+
+        /**
+         * @brief Elemento a ordenar: la clave y el índice de lo que representa (un modelo, un grupo de
+         * triángulos...)
+         *
+         */
+        struct Sort_Entry
+        {
+            uint16_t key;
+            uint32_t index;
+        };
+
+        /**
+         * @brief Cuantiza una distancia a la cámara (la W de las coordenadas de recorte). Los bits de un
+         * float positivo crecen con su valor, por lo que los 16 altos la ordenan con una precisión
+         * relativa de 1/128, igual de fina cerca que lejos. Lo que queda en el plano de la cámara o
+         * detrás recibe la clave 0 y va primero.
+         *
+         */
+        inline uint16_t quantize_depth (float w)
+        {
+            if (!(w > 0.f)) return (0);
+
+            uint32_t bits;
+
+            std::memcpy (&bits, &w, sizeof(bits));
+
+            return (uint16_t(bits >> 16));
+        }
+
+        /**
+         * @brief Ordena entries de menor a mayor clave en dos pasadas de 8 bits, de forma estable.
+         * scratch es un buffer auxiliar que se reutiliza de una llamada a otra para no reservar memoria
+         * en cada frame. Se salta la pasada de un byte si todas las claves coinciden en él.
+         *
+         */
+        inline void radix_sort (std::vector< Sort_Entry > & entries, std::vector< Sort_Entry > & scratch)
+        {
+            size_t counts[2][256] = { };
+
+            for (const Sort_Entry & entry : entries)
+            {
+                counts[0][entry.key & 0xFF]++;
+                counts[1][entry.key >> 8  ]++;
+            }
+
+            scratch.resize (entries.size ());
+
+            for (int pass = 0; pass < 2; ++pass)
+            {
+                size_t * count = counts[pass];
+                int      shift = pass * 8;
+
+                if (count[(entries.empty () ? 0 : entries.front ().key >> shift) & 0xFF] == entries.size ()) continue;
+
+                // Cada cubeta empieza donde acaban las anteriores:
+
+                for (size_t bucket = 0, offset = 0; bucket < 256; ++bucket)
+                {
+                    size_t size = count[bucket];
+
+                    count[bucket] = offset;
+                    offset       += size;
+                }
+
+                for (const Sort_Entry & entry : entries)
+                {
+                    scratch[count[(entry.key >> shift) & 0xFF]++] = entry;
+                }
+
+                entries.swap (scratch);
+            }
+        }
+
+    }
+
+#endif
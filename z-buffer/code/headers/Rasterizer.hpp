@@ -13,9 +13,17 @@
 #define RASTERIZER_HEADER
 
     #include <limits>
+    #include <memory>
+    #include <vector>
     #include <stdint.h>
     #include <Point.hpp>
     #include <algorithm>
+    #include <bitset>
+    #include <cmath>
+    #include <type_traits>
+    #include "Depth_Format.hpp"
+    #include "Simd.hpp"
+    #include "Worker_Pool.hpp"
 
     namespace example
     {
@@ -23,33 +31,427 @@
         using toolkit::Point4i;
         using toolkit::Point4f;
 
-        template< class COLOR_BUFFER_TYPE >
+        /**
+         * @brief Algoritmos de relleno disponibles:
+         *
+         * SCANLINE_ENGINE recorre los lados del polígono y rellena cada scanline pixel a pixel.
+         * HALF_SPACE_ENGINE evalúa las funciones de arista en bloques de 8x8 pixels, 8 pixels a la vez.
+         *
+         */
+        enum Raster_Engine
+        {
+            SCANLINE_ENGINE,
+            HALF_SPACE_ENGINE
+        };
+
+        // El algoritmo por defecto se puede elegir al compilar (por ejemplo /D RASTERIZER_ENGINE=HALF_SPACE_ENGINE):
+
+        #ifndef RASTERIZER_ENGINE
+            #define RASTERIZER_ENGINE SCANLINE_ENGINE
+        #endif
+
+        // Y también el formato del z_buffer (por ejemplo /D RASTERIZER_DEPTH_FORMAT=Depth_Unorm16), ver Depth_Format.hpp:
+
+        #ifndef RASTERIZER_DEPTH_FORMAT
+            #define RASTERIZER_DEPTH_FORMAT Depth_Int32
+        #endif
+
+        // Los contadores de tráfico y el mapa de overdraw solo existen si se activan al compilar (/D RASTERIZER_STATISTICS=1):
+
+        #ifndef RASTERIZER_STATISTICS
+            #define RASTERIZER_STATISTICS 0
+        #endif
+
+        // Bytes a partir de los que clear() escribe sin pasar por la caché, que debería ser algo mayor que
+        // la caché de último nivel del procesador (por ejemplo /D RASTERIZER_STREAMING_CLEAR_BYTES=33554432):
+
+        #ifndef RASTERIZER_STREAMING_CLEAR_BYTES
+            #define RASTERIZER_STREAMING_CLEAR_BYTES 16777216
+        #endif
+
+        template< class COLOR_BUFFER_TYPE, Raster_Engine ENGINE = RASTERIZER_ENGINE, class DEPTH_FORMAT = RASTERIZER_DEPTH_FORMAT >
         class Rasterizer
         {
         public:
 
-            typedef COLOR_BUFFER_TYPE            Color_Buffer;
-            typedef typename Color_Buffer::Color Color;
+            typedef COLOR_BUFFER_TYPE             Color_Buffer;
+            typedef typename Color_Buffer::Color  Color;
+            typedef DEPTH_FORMAT                  Depth_Format;
+            typedef typename Depth_Format::Stored Depth;
+
+            /**
+             * @brief Alto en scanlines de cada tile del modo multihilo. Los tiles ocupan todo el
+             * ancho de la pantalla, de modo que cada uno es un tramo contiguo del z_buffer y del
+             * buffer de color y los polígonos solo se recortan por scanlines.
+             *
+             */
+            static const int tile_rows = 16;
+
+            /**
+             * @brief Lado de los bloques que recorre HALF_SPACE_ENGINE y de los bloques de la Z jerárquica
+             *
+             */
+            static const int block_size = 8;
+
+            /**
+             * @brief Lado máximo, en pixels, del rectángulo envolvente de los triángulos que se rellenan
+             * con rasterize_triangle_stamp() en lugar del algoritmo general
+             *
+             */
+            static const int stamp_size = 4;
+
+            /**
+             * @brief Clasificación de los polígonos enviados a fill_convex_polygon_z_buffer() y
+             * fill_convex_polygon_depth() desde el último clear()
+             *
+             */
+            struct Triangle_Statistics
+            {
+                size_t degenerate;              ///< Triángulos de área nula, descartados
+                size_t empty;                   ///< Triángulos pequeños que no cubren ningún pixel, descartados
+                size_t small;                   ///< Triángulos pequeños rellenados con rasterize_triangle_stamp()
+                size_t regular;                 ///< Resto de triángulos y polígonos de más de tres vértices
+            };
+
+            /**
+             * @brief Trabajo ahorrado por la Z jerárquica desde el último clear()
+             *
+             */
+            struct Hi_Z_Statistics
+            {
+                size_t polygons_tested;         ///< Polígonos comparados con la Z jerárquica
+                size_t polygons_rejected;       ///< Polígonos descartados por completo antes de rellenarlos
+                size_t blocks_rejected;         ///< Spans (SCANLINE_ENGINE) o bloques 8x8 (HALF_SPACE_ENGINE) descartados
+                size_t pixels_rejected;         ///< Pixels que no llegaron a compararse con el z_buffer
+            };
+
+            /**
+             * @brief Trabajo y tráfico de memoria del rasterizado desde el último clear(). Solo se
+             * cuenta con RASTERIZER_STATISTICS: si no, todos los campos quedan a cero. Un span es cada
+             * tramo de pixels que se compara de una vez con el z_buffer (hasta 32 pixels de una
+             * scanline, o una fila de un bloque o de un stamp).
+             *
+             */
+            struct Raster_Statistics
+            {
+                size_t polygons_submitted;      ///< Polígonos recibidos, incluidos los descartados
+                size_t spans;                   ///< Spans comparados con el z_buffer
+                size_t pixels_tested;           ///< Pixels cubiertos comparados con el z_buffer
+                size_t pixels_passed;           ///< Pixels que pasaron el test de profundidad (o el de igualdad)
+                size_t color_writes;            ///< Pixels escritos en el buffer de color (o en el de identificadores)
+                size_t depth_bytes_read;        ///< Bytes leídos del z_buffer por los tests de profundidad
+                size_t depth_bytes_written;     ///< Bytes escritos en el z_buffer por los tests de profundidad
+                size_t color_bytes_written;     ///< Bytes escritos en el buffer de color (o en el de identificadores)
+                size_t depth_bytes_cleared;     ///< Bytes del z_buffer escritos al limpiarlo
+                size_t color_bytes_cleared;     ///< Bytes del buffer de color (o del de identificadores) escritos al limpiarlo
+            };
+
+            static const bool statistics = RASTERIZER_STATISTICS != 0;
+
+            /**
+             * @brief Un clear() que no es diferido escribe con almacenamientos no temporales cuando el
+             * buffer de color (o el de identificadores) y el z_buffer suman al menos streaming_clear_bytes,
+             * y reparte cada buffer entre los hilos en trabajos de al menos clear_job_bytes
+             *
+             */
+            static const size_t streaming_clear_bytes = RASTERIZER_STREAMING_CLEAR_BYTES;
+            static const size_t clear_job_bytes       = 256 * 1024;
+
+            /**
+             * @brief Las coordenadas X e Y de los vértices se expresan en coma fija con subpixel_bits bits
+             * fraccionarios. Cada pixel se muestrea en su centro y los centros que caen justo sobre una
+             * arista solo se pintan si es izquierda u horizontal de menor Y, de modo que los pixels de
+             * una malla cerrada se pintan exactamente una vez por capa con cualquiera de los algoritmos.
+             *
+             */
+            static const int subpixel_bits = 4;
+            static const int subpixel_size = 1 << subpixel_bits;
+
+            /**
+             * @brief Mayor coordenada, en pixels, que admiten los vértices. Quien llama tiene que recortar
+             * los polígonos que se salen de esta banda de guarda.
+             *
+             */
+            static const int guard_band_limit = 8192;
+
+            /**
+             * @brief Pixels escritos en un bloque tras los que se recalcula su Z jerárquica
+             *
+             */
+            static const int hi_z_refresh_writes = 2 * block_size * block_size;
+
+            /**
+             * @brief Test de profundidad de fill_convex_polygon_z_buffer(). Con DEPTH_TEST_EQUAL solo se
+             * pintan los pixels cuya Z coincide con la guardada y el z_buffer no se modifica, lo que tras
+             * una pasada de fill_convex_polygon_depth() colorea cada pixel una sola vez. Si varios polígonos
+             * dejan la misma Z en un pixel, lo colorea el que la escribió en la pasada previa, el primero
+             * que se envió, igual que con DEPTH_TEST_LESS. Para ello las dos pasadas deben enviar los
+             * mismos polígonos en el mismo orden.
+             *
+             */
+            enum Depth_Test
+            {
+                DEPTH_TEST_LESS,
+                DEPTH_TEST_EQUAL
+            };
+
+            /**
+             * @brief Identificador de primitiva del modo visibility buffer: índice del modelo en los 12
+             * bits altos e índice del triángulo dentro del modelo en los triangle_bits bajos
+             *
+             */
+            typedef uint32_t Primitive_Id;
+
+            static const int          triangle_bits = 20;
+            static const Primitive_Id no_primitive  = 0xFFFFFFFF;
+
+            static Primitive_Id pack_primitive_id (uint32_t model, uint32_t triangle)
+            {
+                return ((model << triangle_bits) | (triangle & ((uint32_t(1) << triangle_bits) - 1)));
+            }
+
+            static uint32_t primitive_model (Primitive_Id id)
+            {
+                return (id >> triangle_bits);
+            }
+
+            static uint32_t primitive_triangle (Primitive_Id id)
+            {
+                return (id & ((uint32_t(1) << triangle_bits) - 1));
+            }
+
+            /**
+             * @brief Consulta de oclusión activa cuando no hay ninguna (ver begin_query())
+             *
+             */
+            static const int no_query = -1;
 
         private:
 
-            Color_Buffer & color_buffer;
+            /**
+             * @brief Datos temporales de cada hilo: las tablas con las que se recorren los lados del
+             * polígono y las estadísticas de la Z jerárquica.
+             *
+             * Las cuatro tablas tienen una entrada por scanline y se reservan juntas una sola vez, con
+             * cada una alineada al comienzo de una línea de caché para que dos hilos nunca compartan
+             * líneas. Se guardan posiciones X en lugar de offsets para que ningún valor intermedio
+             * dependa del tamaño del buffer.
+             *
+             */
+            struct Worker_Cache
+            {
+                static const size_t cache_line = 64;
+                static const size_t line_ints  = cache_line / sizeof(int);
+
+                std::vector< int > tables;
+                size_t             table_size;
+
+                Hi_Z_Statistics    hi_z_statistics;
+                size_t             color_writes;
+
+                std::vector< size_t > query_samples;
 
-            int offset_cache0[1082];
-            int offset_cache1[1082];
+                Raster_Statistics  raster_statistics;
 
-            int z_cache0[1082];
-            int z_cache1[1082];
+                Worker_Cache() : table_size(0), hi_z_statistics(), color_writes(0), raster_statistics()
+                {
+                }
+
+                void allocate (size_t rows)
+                {
+                    table_size = (rows + line_ints - 1) / line_ints * line_ints;
+
+                    tables.assign (4 * table_size + line_ints, 0);
+                }
+
+                int * x_cache0 () { return (aligned_tables () + 0 * table_size); }
+                int * x_cache1 () { return (aligned_tables () + 1 * table_size); }
+                int * z_cache0 () { return (aligned_tables () + 2 * table_size); }
+                int * z_cache1 () { return (aligned_tables () + 3 * table_size); }
+
+            private:
+
+                int * aligned_tables ()
+                {
+                    uintptr_t address = reinterpret_cast< uintptr_t >(tables.data ());
+
+                    return (reinterpret_cast< int * >((address + cache_line - 1) & ~uintptr_t(cache_line - 1)));
+                }
+            };
+
+            /**
+             * @brief Lo que se escribe en los pixels que pasan el test de profundidad: el color o, en el
+             * modo visibility buffer, el identificador de la primitiva
+             *
+             */
+            struct Surface
+            {
+                Color        color;
+                Primitive_Id id;
+                uint8_t      pass;
+                int          query;
+                uint32_t     owner;
+            };
+
+            /**
+             * @brief Cobertura de un triángulo pequeño: el bit i de coverage[row] corresponde al pixel
+             * (x + i, y + row). La Z se guarda como el plano del triángulo evaluado en el
+             * centro del pixel (x, y), junto con la menor Z de sus vértices para la Z jerárquica.
+             *
+             */
+            struct Stamp
+            {
+                int      x;
+                int      y;
+                int      rows;
+                int      columns;
+                uint32_t coverage[stamp_size + 1];
+                double   z;
+                double   z_dx;
+                double   z_dy;
+                int      z_near;
+            };
+
+            /**
+             * @brief Pasada a la que pertenece cada polígono: con PASS_DEPTH_ONLY solo se escribe la Z y
+             * con PASS_EQUAL solo el color de los pixels con la misma Z que la guardada
+             *
+             */
+            enum
+            {
+                PASS_SHADE,
+                PASS_DEPTH_ONLY,
+                PASS_EQUAL
+            };
+
+            /**
+             * @brief Polígono pendiente de rasterizar en el modo multihilo
+             *
+             */
+            struct Binned_Polygon
+            {
+                size_t  first_vertex;
+                size_t  vertex_count;
+                Surface surface;
+            };
 
-            std::vector< int > z_buffer;
+        private:
+
+            Color_Buffer & color_buffer;
+
+            std::vector< Worker_Cache > worker_caches;
+
+            std::vector< Depth > z_buffer;
+
+            /**
+             * @brief Número de orden del polígono que escribió la Z de cada pixel en la pasada previa de
+             * profundidad. Cada polígono recibe el siguiente polygon_serial al enviarse y la pasada de
+             * igualdad vuelve a contar desde first_serial, de modo que solo colorea un pixel el polígono
+             * que ganó su Z aunque otro deje la misma. Los números no se repiten entre frames, así que
+             * no hace falta limpiarlo. Se reserva con la primera pasada de profundidad.
+             *
+             */
+            std::vector< uint32_t > depth_owners;
+            uint32_t                polygon_serial;
+            uint32_t                first_serial;
+
+            static const uint32_t no_owner = 0xFFFFFFFF;
+
+            /**
+             * @brief Con Depth_Int32 el z_buffer guarda la Z tal cual se interpola y HALF_SPACE_ENGINE
+             * lo lee y lo escribe 8 pixels a la vez
+             *
+             */
+            static const bool native_depth = std::is_same< Depth_Format, Depth_Int32 >::value;
+
+            /**
+             * @brief Z jerárquica: cota superior de la Z almacenada en cada bloque de 8x8 pixels. Un
+             * pixel con una Z mayor o igual que la de su bloque no puede pasar el test de profundidad.
+             * La cota se recalcula cuando se han escrito en el bloque hi_z_refresh_writes pixels, lo que
+             * cuesta media lectura adicional del z_buffer por pixel escrito.
+             *
+             */
+            std::vector< int     > hi_z;
+            std::vector< uint8_t > hi_z_writes;
+            int                    hi_z_columns;
+
+            /**
+             * @brief Limpieza diferida: con fast_clear, clear() solo marca cada bloque de la Z jerárquica
+             * como pendiente de limpiar (PENDING_COLOR | PENDING_DEPTH). Un bloque se limpia al pintar
+             * en él por primera vez y flush() limpia el color de los que no se han llegado a tocar. En el
+             * modo visibility buffer PENDING_COLOR se refiere al buffer de identificadores.
+             *
+             */
+            enum
+            {
+                PENDING_COLOR = 1,
+                PENDING_DEPTH = 2
+            };
+
+            bool                   fast_clear;
+            Color                  clear_color;
+            std::vector< uint8_t > pending_clears;
+
+            /**
+             * @brief Modo visibility buffer: los polígonos solo escriben la Z y su identificador de
+             * primitiva, y el color de cada pixel visible se calcula después en resolve_visibility()
+             *
+             */
+            bool                        visibility_mode;
+            Primitive_Id                primitive_id;
+            Depth_Test                  depth_test;
+            std::vector< Primitive_Id > id_buffer;
+
+            Triangle_Statistics         triangle_statistics;
+
+            /**
+             * @brief Consulta de oclusión a la que se suman los pixels que pasan el test de profundidad
+             * y número de consultas para las que hay contadores en cada Worker_Cache
+             *
+             */
+            int                         active_query;
+            size_t                      query_count;
+
+            /**
+             * @brief Veces que se ha escrito el color de cada pixel desde el último clear(), saturadas a
+             * 65535. Solo se reserva con RASTERIZER_STATISTICS. Los hilos escriben en tiles distintos,
+             * por lo que no comparten contadores.
+             *
+             */
+            std::vector< uint16_t >     overdraw;
+
+            std::unique_ptr< Worker_Pool >      worker_pool;
+            std::vector< Binned_Polygon >       binned_polygons;
+            std::vector< Point4i >              binned_vertices;
+            std::vector< int >                  binned_indices;
+            std::vector< std::vector< size_t > > tile_bins;
 
         public:
 
             Rasterizer(Color_Buffer & target)
             :
                 color_buffer(target),
-                z_buffer(target.get_width () * target.get_height ())
+                worker_caches (1),
+                z_buffer(target.size ()),
+                polygon_serial(0),
+                first_serial(0),
+                hi_z_columns(int(target.get_width () + block_size - 1) / block_size),
+                fast_clear  (false),
+                visibility_mode(false),
+                primitive_id(no_primitive),
+                depth_test  (DEPTH_TEST_LESS),
+                triangle_statistics(),
+                active_query(no_query),
+                query_count (0),
+                overdraw    (statistics ? target.size () : 0)
             {
+                worker_caches[0].allocate (edge_cache_rows ());
+
+                size_t hi_z_rows = (target.get_height () + block_size - 1) / block_size;
+
+                hi_z      .assign (hi_z_columns * hi_z_rows, Depth_Format::bound (Depth_Format::far_value ()));
+                hi_z_writes.assign (hi_z_columns * hi_z_rows, 0);
+                pending_clears.assign (hi_z_columns * hi_z_rows, 0);
             }
 
             const Color_Buffer & get_color_buffer () const
@@ -69,200 +471,1550 @@
                 color_buffer.set_color (r, g, b);
             }
 
-            void clear ()
+            /**
+             * @brief Identificador que escriben los siguientes polígonos en el modo visibility buffer
+             *
+             */
+            void set_primitive_id (Primitive_Id new_id)
+            {
+                primitive_id = new_id;
+            }
+
+            void set_depth_test (Depth_Test new_depth_test)
+            {
+                depth_test = new_depth_test;
+
+                if (depth_test == DEPTH_TEST_EQUAL) polygon_serial = first_serial;
+            }
+
+            Depth_Test get_depth_test () const
+            {
+                return (depth_test);
+            }
+
+/**
+ * @brief Ajusta el numero de hilos que rasterizan. Con mas de uno, fill_convex_polygon_z_buffer()
+ * solo reparte los polígonos entre los tiles que tocan y el pintado se realiza en flush().
+ * 
+ * @param worker_count Numero de hilos (incluido el que llama a flush())
+ */
+            void set_worker_count (size_t worker_count)
             {
-                for (Color * c = color_buffer.colors (), * end = c + color_buffer.size (); c < end; c++)
+                flush ();
+
+                if (worker_count < 1) worker_count = 1;
+
+                worker_caches.resize (worker_count);
+
+                for (auto & cache : worker_caches)
                 {
-					*c = 0;
+                    if (cache.tables.empty ()) cache.allocate (edge_cache_rows ());
+
+                    cache.query_samples.resize (query_count, 0);
+                }
+
+                if (worker_count > 1)
+                {
+                    worker_pool.reset (new Worker_Pool(worker_count));
+                    tile_bins.resize ((color_buffer.get_height () + tile_rows - 1) / tile_rows);
                 }
+                else
+                {
+                    worker_pool.reset ();
+                    tile_bins.clear ();
+                }
+            }
 
-                for (int * z = z_buffer.data (), * end = z + z_buffer.size (); z != end; z++)
+            size_t get_worker_count () const
+            {
+                return (worker_caches.size ());
+            }
+
+/**
+ * @brief Activa la limpieza diferida. clear() pasa a costar una escritura por bloque de 8x8 pixels y
+ * cada bloque se limpia la primera vez que se pinta en él o, si no se pinta, en flush(). El buffer de
+ * color solo está completo tras llamar a flush().
+ * 
+ * @param enabled 
+ */
+            void set_fast_clear (bool enabled)
+            {
+                if (!enabled && fast_clear)
                 {
-                    *z = std::numeric_limits< int >::max ();
+                    flush ();
+                    resolve_pending_clears (worker_caches[0], 0, int(color_buffer.get_height ()), PENDING_COLOR | PENDING_DEPTH);
                 }
 
+                fast_clear = enabled;
+            }
 
+            bool get_fast_clear () const
+            {
+                return (fast_clear);
             }
 
 /**
- * @brief Limpia el buffer de colores con el color recibido
+ * @brief Activa el modo visibility buffer. Los polígonos pasan a escribir solo la Z y el identificador
+ * fijado con set_primitive_id() y el buffer de color se rellena en resolve_visibility(), evaluando el
+ * color una vez por pixel visible independientemente del overdraw. El cambio se aplica a partir del
+ * siguiente clear().
  * 
- * @param r 
- * @param g 
- * @param b 
+ * @param enabled 
  */
-			void clear(int r, int g, int b)
-			{
-				for (Color * c = color_buffer.colors(), *end = c + color_buffer.size(); c < end; c++)
-				{
-					c->data.component.r = r;
-					c->data.component.g = g;
-					c->data.component.b = b;
-				}
+            void set_visibility_mode (bool enabled)
+            {
+                if (enabled == visibility_mode) return;
 
-				for (int * z = z_buffer.data(), *end = z + z_buffer.size(); z != end; z++)
-				{
-					*z = std::numeric_limits< int >::max();
-				}
+                flush ();
 
+                if (fast_clear) resolve_pending_clears (worker_caches[0], 0, int(color_buffer.get_height ()), PENDING_COLOR | PENDING_DEPTH);
 
-			}
+                if (enabled)
+                {
+                    id_buffer.assign (color_buffer.size (), no_primitive);
+                }
+                else
+                {
+                    std::vector< Primitive_Id > ().swap (id_buffer);
+                }
 
+                visibility_mode = enabled;
+            }
 
-            void fill_convex_polygon
-            (
-                const Point4i * const vertices, 
-                const int     * const indices_begin, 
-                const int     * const indices_end
-            );
+            bool get_visibility_mode () const
+            {
+                return (visibility_mode);
+            }
 
-            void fill_convex_polygon_z_buffer
-            (
-                const Point4i * const vertices, 
-                const int     * const indices_begin, 
-                const int     * const indices_end
-            );
+/**
+ * @brief Devuelve el identificador de la primitiva visible en un pixel (no_primitive si no hay ninguna,
+ * si el pixel queda fuera de la pantalla o si no está activo el modo visibility buffer). Solo es válido
+ * tras flush() o resolve_visibility().
+ * 
+ * @param x 
+ * @param y 
+ * @return Primitive_Id 
+ */
+            Primitive_Id get_primitive_id (int x, int y) const
+            {
+                if (!visibility_mode || x < 0 || y < 0) return (no_primitive);
+                if (size_t(x) >= color_buffer.get_width () || size_t(y) >= color_buffer.get_height ()) return (no_primitive);
 
-        private:
+                return (id_buffer[color_buffer.offset_at (size_t(x), size_t(y))]);
+            }
 
-            template< typename VALUE_TYPE, size_t SHIFT >
-            void interpolate (int   * cache, int   v0, int   v1, int y_min, int y_max);
+/**
+ * @brief Rasteriza los polígonos pendientes y, en el modo visibility buffer, rellena el buffer de color
+ * con shader(id), que tiene que devolver el color de la primitiva id. Los pixels sin primitiva reciben
+ * el color del último clear(). Los pixels consecutivos de una misma primitiva comparten la llamada al
+ * shader y, con varios hilos, cada uno resuelve tiles completos, por lo que shader tiene que poder
+ * llamarse de forma concurrente.
+ * 
+ * @param shader 
+ */
+            template< class SHADER >
+            void resolve_visibility (const SHADER & shader);
 
-        };
+            Hi_Z_Statistics get_hi_z_statistics () const
+            {
+                Hi_Z_Statistics total = Hi_Z_Statistics();
 
-        template< class  COLOR_BUFFER_TYPE >
-        void Rasterizer< COLOR_BUFFER_TYPE >::fill_convex_polygon
-        (
-            const Point4i * const vertices, 
-            const int     * const indices_begin, 
-            const int     * const indices_end
-        )
-        {
-            // Se cachean algunos valores de interés:
+                for (auto & cache : worker_caches)
+                {
+                    total.polygons_tested   += cache.hi_z_statistics.polygons_tested;
+                    total.polygons_rejected += cache.hi_z_statistics.polygons_rejected;
+                    total.blocks_rejected   += cache.hi_z_statistics.blocks_rejected;
+                    total.pixels_rejected   += cache.hi_z_statistics.pixels_rejected;
+                }
 
-                  int   pitch         = color_buffer.get_width ();
-                  int * offset_cache0 = this->offset_cache0;
-                  int * offset_cache1 = this->offset_cache1;
-            const int * indices_back  = indices_end - 1;
+                return (total);
+            }
 
-            // Se busca el vértice de inicio (el que tiene menor Y) y el de terminación (el que tiene mayor Y):
+/**
+ * @brief Devuelve los pixels escritos en el buffer de color (o en el de identificadores en el modo
+ * visibility buffer) desde el último clear()
+ * 
+ * @return size_t 
+ */
+            size_t get_color_writes () const
+            {
+                size_t total = 0;
 
-            const int * start_index   = indices_begin;
-                  int   start_y       = vertices[*start_index].coordinates ()[1];
-            const int * end_index     = indices_begin;
-                  int   end_y         = start_y;
+                for (auto & cache : worker_caches) total += cache.color_writes;
 
-            for (const int * index_iterator = start_index; ++index_iterator < indices_end; )
+                return (total);
+            }
+
+            Triangle_Statistics get_triangle_statistics () const
             {
-                int current_y = vertices[*index_iterator].coordinates ()[1];
+                return (triangle_statistics);
+            }
 
-                if (current_y < start_y)
+/**
+ * @brief Devuelve los contadores de trabajo y de tráfico de memoria desde el último clear(). Rasteriza
+ * antes los polígonos pendientes. Sin RASTERIZER_STATISTICS todos son cero.
+ * 
+ * @return Raster_Statistics 
+ */
+            Raster_Statistics get_raster_statistics ()
+            {
+                flush ();
+
+                Raster_Statistics total = Raster_Statistics();
+
+                for (auto & cache : worker_caches)
                 {
-                    start_y     = current_y; 
-                    start_index = index_iterator;
+                    const Raster_Statistics & partial = cache.raster_statistics;
+
+                    total.spans               += partial.spans;
+                    total.pixels_tested       += partial.pixels_tested;
+                    total.pixels_passed       += partial.pixels_passed;
+                    total.color_writes        += partial.color_writes;
+                    total.depth_bytes_read    += partial.depth_bytes_read;
+                    total.depth_bytes_written += partial.depth_bytes_written;
+                    total.color_bytes_written += partial.color_bytes_written;
+                    total.depth_bytes_cleared += partial.depth_bytes_cleared;
+                    total.color_bytes_cleared += partial.color_bytes_cleared;
                 }
-                else
-                if (current_y > end_y)
+
+                if (statistics)
                 {
-                    end_y       = current_y;
-                    end_index   = index_iterator;
+                    total.polygons_submitted = triangle_statistics.degenerate + triangle_statistics.empty
+                                             + triangle_statistics.small      + triangle_statistics.regular;
                 }
+
+                return (total);
             }
 
-            // Se cachean las coordenadas X de los lados que van desde el vértice con Y menor al
-            // vértice con Y mayor en sentido antihorario:
+/**
+ * @brief Devuelve, por pixel y en el orden del buffer de color, cuántas veces se ha escrito su color
+ * desde el último clear(). Rasteriza antes los polígonos pendientes. Sin RASTERIZER_STATISTICS está
+ * vacío.
+ * 
+ * @return const std::vector< uint16_t >& 
+ */
+            const std::vector< uint16_t > & get_overdraw ()
+            {
+                flush ();
 
-            const int * current_index = start_index;
-            const int *    next_index = start_index > indices_begin ? start_index - 1 : indices_back;
+                return (overdraw);
+            }
 
-            int y0 = vertices[*current_index].coordinates ()[1];
-            int y1 = vertices[*   next_index].coordinates ()[1];
-            int o0 = vertices[*current_index].coordinates ()[0] + y0 * pitch;
-            int o1 = vertices[*   next_index].coordinates ()[0] + y1 * pitch;
+/**
+ * @brief Comienza una consulta de oclusión: hasta end_query(), los pixels de los polígonos enviados
+ * que pasan el test de profundidad (o el de igualdad) se suman al contador query. Los contadores se
+ * ponen a cero en clear(), por lo que una misma consulta puede abrirse varias veces en un frame y
+ * acumula todas ellas. Las consultas se identifican con enteros pequeños elegidos por quien llama.
+ * 
+ * @param query 
+ */
+            void begin_query (int query)
+            {
+                if (size_t(query) >= query_count)
+                {
+                    query_count = size_t(query) + 1;
 
-            while (true)
+                    for (auto & cache : worker_caches) cache.query_samples.resize (query_count, 0);
+                }
+
+                active_query = query;
+            }
+
+            void end_query ()
             {
-                interpolate< int64_t, 32 > (offset_cache0, o0, o1, y0, y1);
+                active_query = no_query;
+            }
 
-                if (current_index == indices_begin) current_index = indices_back; else current_index--;
-                if (current_index == end_index    ) break;
-                if (   next_index == indices_begin) next_index    = indices_back; else    next_index--;
+/**
+ * @brief Devuelve los pixels que han pasado el test de profundidad en la consulta query desde el
+ * último clear(). Rasteriza antes los polígonos pendientes.
+ * 
+ * @param query 
+ * @return size_t 
+ */
+            size_t get_query_result (int query)
+            {
+                flush ();
 
-                y0 = y1;
-                y1 = vertices[*next_index].coordinates ()[1];
-                o0 = o1;
-                o1 = vertices[*next_index].coordinates ()[0] + y1 * pitch;
+                size_t total = 0;
+
+                if (query == no_query || size_t(query) >= query_count) return (total);
+
+                for (auto & cache : worker_caches) total += cache.query_samples[query];
+
+                return (total);
             }
 
-            int end_offset = o1;
+/**
+ * @brief Comprueba, sin pintar nada, si algún pixel del rectángulo [x_min, x_max] x [y_min, y_max]
+ * pasaría el test de profundidad con la Z z. Sirve para saber si un objeto podría verse probando su
+ * caja envolvente proyectada, con z su Z más cercana. Rasteriza antes los polígonos pendientes.
+ * 
+ * @return true si alguno de los pixels pasaría el test
+ */
+            bool is_rectangle_visible (int x_min, int y_min, int x_max, int y_max, int z);
 
-            // Se cachean las coordenadas X de los lados que van desde el vértice con Y menor al
-            // vértice con Y mayor en sentido horario:
+/**
+ * @brief Rasteriza en paralelo los polígonos pendientes. Cada hilo procesa tiles completos, por lo
+ * que ningún pixel se bloquea y cada tile recibe sus polígonos en el orden de envío: el resultado es
+ * idéntico al del modo de un hilo. También se limpia el color de los bloques que no se han tocado
+ * desde un clear() diferido.
+ * 
+ */
+            void flush ()
+            {
+                int height = int(color_buffer.get_height ());
 
-            current_index = start_index;
-               next_index = start_index < indices_back ? start_index + 1 : indices_begin;
+                if (binned_polygons.empty ())
+                {
+                    if (fast_clear) resolve_pending_clears (worker_caches[0], 0, height, PENDING_COLOR);
+                    return;
+                }
 
-            y0 = vertices[*current_index].coordinates ()[1];
-            y1 = vertices[*   next_index].coordinates ()[1];
-            o0 = vertices[*current_index].coordinates ()[0] + y0 * pitch;
-            o1 = vertices[*   next_index].coordinates ()[0] + y1 * pitch;
+                worker_pool->run
+                (
+                    tile_bins.size (),
+                    [this, height] (size_t tile, size_t worker)
+                    {
+                        int clip_top    = int(tile) * tile_rows;
+                        int clip_bottom = std::min (clip_top + tile_rows, height);
 
-            while (true)
+                        for (size_t index : tile_bins[tile])
+                        {
+                            const Binned_Polygon & polygon = binned_polygons[index];
+
+                            rasterize_polygon_z_buffer
+                            (
+                                worker_caches[worker],
+                                binned_vertices.data () + polygon.first_vertex,
+                                binned_indices .data (),
+                                binned_indices .data () + polygon.vertex_count,
+                                polygon.surface,
+                                clip_top,
+                                clip_bottom
+                            );
+                        }
+
+                        tile_bins[tile].clear ();
+
+                        if (fast_clear) resolve_pending_clears (worker_caches[worker], clip_top, clip_bottom, PENDING_COLOR);
+                    }
+                );
+
+                binned_polygons.clear ();
+                binned_vertices.clear ();
+            }
+
+            void clear ()
             {
-                interpolate< int64_t, 32 > (offset_cache1, o0, o1, y0, y1);
+                Color color;
 
-                if (current_index == indices_back) current_index = indices_begin; else current_index++;
-                if (current_index == end_index   ) break;
-                if (   next_index == indices_back) next_index    = indices_begin; else next_index++;
+                color = 0;
+
+                clear (color);
+            }
+
+/**
+ * @brief Limpia el buffer de colores con el color recibido
+ * 
+ * @param r 
+ * @param g 
+ * @param b 
+ */
+			void clear(int r, int g, int b)
+			{
+				Color color;
+
+				color.set (r, g, b);
+
+				clear (color);
+			}
+
+/**
+ * @brief Limpia el buffer de colores con un color ya empaquetado en el formato del buffer y el z_buffer
+ * con la Z lejana
+ * 
+ * @param color 
+ */
+            void clear (const Color & color)
+            {
+                discard_binned_polygons ();
+
+                clear_color = color;
+
+                if (fast_clear)
+                {
+                    defer_clear ();
+                    return;
+                }
+
+                size_t color_bytes = color_buffer.size () * (visibility_mode ? sizeof(Primitive_Id) : sizeof(Color));
+                bool   streaming   = color_bytes + z_buffer.size () * sizeof(Depth) >= streaming_clear_bytes;
+
+                if (visibility_mode) fill_buffer (id_buffer.data (), id_buffer.size (), no_primitive, streaming);
+                else                 fill_buffer (color_buffer.colors (), color_buffer.size (), color, streaming);
+
+                fill_buffer (z_buffer.data (), z_buffer.size (), Depth_Format::far_value (), streaming);
+
+                reset_hi_z ();
+                count_full_clear ();
+            }
+
+
+            void fill_convex_polygon
+            (
+                const Point4i * const vertices, 
+                const int     * const indices_begin, 
+                const int     * const indices_end
+            );
+
+            void fill_convex_polygon_z_buffer
+            (
+                const Point4i * const vertices, 
+                const int     * const indices_begin, 
+                const int     * const indices_end
+            );
+
+            /**
+             * @brief Variante de fill_convex_polygon_z_buffer() que solo escribe la Z, para la pasada
+             * previa de profundidad
+             *
+             */
+            void fill_convex_polygon_depth
+            (
+                const Point4i * const vertices, 
+                const int     * const indices_begin, 
+                const int     * const indices_end
+            );
+
+            /**
+             * @brief Rellena de una vez triangle_count triángulos indexados, con el test de profundidad
+             * de set_depth_test(). Cada triángulo recibe su color de colors o, en el modo visibility
+             * buffer, su identificador de ids (el otro array puede ser nullptr). Equivale a llamar a
+             * fill_convex_polygon_z_buffer() por cada triángulo tras fijar su color, pero sin pasar
+             * por set_color() ni preparar la superficie en cada uno.
+             *
+             */
+            void fill_triangles_z_buffer
+            (
+                const Point4i      * const vertices, 
+                const int          * const indices, 
+                      size_t               triangle_count,
+                const Color        * const colors,
+                const Primitive_Id * const ids
+            );
+
+            /**
+             * @brief Variante de fill_triangles_z_buffer() que solo escribe la Z
+             *
+             */
+            void fill_triangles_depth
+            (
+                const Point4i * const vertices, 
+                const int     * const indices, 
+                      size_t          triangle_count
+            );
+
+        private:
+
+            /**
+             * @brief Entradas de cada tabla de lados: una por scanline más la que escribe el último
+             * vértice de un polígono que llega hasta el borde inferior
+             *
+             */
+            size_t edge_cache_rows () const
+            {
+                return (color_buffer.get_height () + 2);
+            }
+
+            void submit_polygon
+            (
+                const Point4i * const vertices, 
+                const int     * const indices_begin, 
+                const int     * const indices_end,
+                      Surface         surface
+            );
+
+            void bin_polygon
+            (
+                const Point4i * const vertices, 
+                const int     * const indices_begin, 
+                const int     * const indices_end,
+                const Surface &       surface
+            );
+
+            void discard_binned_polygons ()
+            {
+                for (auto & bin : tile_bins) bin.clear ();
+
+                binned_polygons.clear ();
+                binned_vertices.clear ();
+            }
+
+            Surface current_surface (bool depth_only) const
+            {
+                Surface surface;
+
+                surface.color = color_buffer.get_color ();
+                surface.id    = primitive_id;
+                surface.pass  = uint8_t(depth_only ? PASS_DEPTH_ONLY : depth_test == DEPTH_TEST_EQUAL ? PASS_EQUAL : PASS_SHADE);
+                surface.query = active_query;
+                surface.owner = 0;
+
+                return (surface);
+            }
+
+            /**
+             * @brief Reserva depth_owners antes de la primera pasada de profundidad. Ningún polígono
+             * recibe no_owner hasta que polygon_serial da la vuelta.
+             *
+             */
+            void allocate_depth_owners ()
+            {
+                if (depth_owners.empty ()) depth_owners.assign (z_buffer.size (), no_owner);
+            }
+
+            /**
+             * @brief En la pasada de igualdad, si el pixel lo ganó en la pasada previa el polígono de
+             * surface (o no ha habido pasada previa)
+             *
+             */
+            bool owns_pixel (const Surface & surface, size_t offset) const
+            {
+                return (depth_owners.empty () || depth_owners[offset] == surface.owner);
+            }
+
+            /**
+             * @brief Anota el polígono que ha escrito la Z del pixel en la pasada previa
+             *
+             */
+            void claim_pixel (const Surface & surface, size_t offset)
+            {
+                if (surface.pass == PASS_DEPTH_ONLY) depth_owners[offset] = surface.owner;
+            }
+
+            /**
+             * @brief Margen que se suma a la Z jerárquica antes de descartar. En la pasada de igualdad
+             * también pasan las Z iguales a la guardada y, con los formatos que no son Depth_Int32,
+             * varias Z enteras comparten el mismo valor guardado, por lo que no se descarta nada.
+             *
+             */
+            static int64_t hi_z_slack (const Surface & surface)
+            {
+                if (surface.pass != PASS_EQUAL) return (0);
+
+                return (native_depth ? 1 : int64_t(1) << 40);
+            }
+
+            /**
+             * @brief Satura a [0, depth_max] una Z extrapolada en 64 bits. Al avanzar la Z hasta el borde
+             * de la pantalla o hasta el final de un span muy largo se puede salir del rango de int.
+             *
+             */
+            static int clamp_depth (int64_t z)
+            {
+                return (int(std::min (std::max (z, int64_t(0)), int64_t(depth_max))));
+            }
+
+            /**
+             * @brief Posición del pixel (x, y) en el z_buffer, el buffer de color y los demás buffers por
+             * pixel, que comparten la disposición del buffer de color (por filas o en tiles)
+             *
+             */
+            size_t pixel_offset (int x, int y) const
+            {
+                return (color_buffer.offset_at (size_t(x), size_t(y)));
+            }
+
+            /**
+             * @brief Cuántos de los count pixels de una scanline que empiezan en la columna x están
+             * seguidos en memoria: todos por filas y hasta el final del tile con la disposición en tiles
+             *
+             */
+            int contiguous_pixels (int x, int count) const
+            {
+                static_assert (Color_Buffer::tile_size == block_size, "Los tiles del buffer de color tienen que coincidir con los bloques");
+
+                if (!color_buffer.is_tiled ()) return (count);
+
+                return (std::min (count, block_size - x % block_size));
+            }
+
+            /**
+             * @brief Distancia en memoria entre un pixel y el de debajo dentro de un mismo bloque
+             *
+             */
+            size_t row_pitch () const
+            {
+                return (color_buffer.is_tiled () ? size_t(block_size) : color_buffer.get_width ());
+            }
+
+            /**
+             * @brief Escribe la superficie en los pixels del span [offset, offset + count) cuyo bit de
+             * mask está activo (count <= 32)
+             *
+             */
+            void write_span_masked (Worker_Cache & cache, size_t offset, size_t count, uint32_t mask, const Surface & surface)
+            {
+                size_t written = std::bitset< 32 >(mask).count ();
+
+                cache.color_writes += written;
+
+                if (statistics)
+                {
+                    cache.raster_statistics.color_writes        += written;
+                    cache.raster_statistics.color_bytes_written += written * (visibility_mode ? sizeof(Primitive_Id) : sizeof(Color));
+
+                    uint16_t * counter = overdraw.data () + offset;
+
+                    for (uint32_t bits = mask; bits != 0; bits >>= 1, ++counter)
+                    {
+                        if ((bits & 1) && *counter != 0xFFFF) ++*counter;
+                    }
+                }
+
+                if (!visibility_mode)
+                {
+                    color_buffer.fill_span_masked (offset, count, mask, surface.color);
+                    return;
+                }
+
+                for (Primitive_Id * target = id_buffer.data () + offset; mask != 0; mask >>= 1, ++target)
+                {
+                    if (mask & 1) *target = surface.id;
+                }
+            }
+
+            /**
+             * @brief Suma a la consulta de oclusión de la superficie los pixels de mask, que son los que
+             * han pasado el test de profundidad
+             *
+             */
+            static void count_query_samples (Worker_Cache & cache, uint32_t mask, const Surface & surface)
+            {
+                if (surface.query != no_query) cache.query_samples[surface.query] += std::bitset< 32 >(mask).count ();
+            }
+
+            /**
+             * @brief Cuenta un span comparado con el z_buffer: tested pixels cubiertos, de los que han
+             * pasado el test los de passed. Si el span se lee (y, cuando pasa algún pixel, se escribe)
+             * entero con SIMD, vector_lanes es su ancho. Solo se llama con RASTERIZER_STATISTICS, de
+             * modo que sin ella no cuesta nada.
+             *
+             */
+            static void count_depth_test (Worker_Cache & cache, int tested, uint32_t passed, const Surface & surface, int vector_lanes = 0)
+            {
+                if (tested == 0) return;
+
+                Raster_Statistics & counters     = cache.raster_statistics;
+                size_t              passed_count = std::bitset< 32 >(passed).count ();
+
+                counters.spans            += 1;
+                counters.pixels_tested    += size_t(tested);
+                counters.pixels_passed    += passed_count;
+                counters.depth_bytes_read += size_t(vector_lanes ? vector_lanes : tested) * sizeof(Depth);
+
+                if (surface.pass != PASS_EQUAL && passed != 0)
+                {
+                    counters.depth_bytes_written += (vector_lanes ? size_t(vector_lanes) : passed_count) * sizeof(Depth);
+                }
+            }
+
+            /**
+             * @brief Cuenta los bytes escritos por un clear() que no es diferido, después de que
+             * reset_hi_z() haya puesto los contadores a cero
+             *
+             */
+            void count_full_clear ()
+            {
+                if (!statistics) return;
+
+                size_t pixels = z_buffer.size ();
+
+                worker_caches[0].raster_statistics.depth_bytes_cleared += pixels * sizeof(Depth);
+                worker_caches[0].raster_statistics.color_bytes_cleared += pixels * (visibility_mode ? sizeof(Primitive_Id) : sizeof(Color));
+            }
+
+            template< class SHADER >
+            void resolve_visibility_rows (int top, int bottom, const SHADER & shader);
+
+            /**
+             * @brief Escribe value en todo un buffer con fill_pattern(). Si hay varios hilos y el buffer
+             * es grande, cada uno escribe un tramo seguido de un múltiplo de 64 elementos, por lo que dos
+             * hilos no comparten ninguna línea de caché si el buffer empieza en una.
+             *
+             */
+            template< class T >
+            void fill_buffer (T * target, size_t count, const T & value, bool streaming)
+            {
+                size_t jobs = worker_pool ? std::min (worker_pool->get_worker_count (), count * sizeof(T) / clear_job_bytes) : 1;
+
+                if (jobs < 2)
+                {
+                    fill_pattern (target, count, value, streaming);
+                    return;
+                }
+
+                size_t step = (count / jobs + 63) & ~size_t(63);
+
+                worker_pool->run
+                (
+                    jobs,
+                    [target, count, step, &value, streaming] (size_t job, size_t)
+                    {
+                        size_t begin = job * step;
+
+                        if (begin < count) fill_pattern (target + begin, std::min (step, count - begin), value, streaming);
+                    }
+                );
+            }
+
+            void defer_clear ()
+            {
+                std::fill (pending_clears.begin (), pending_clears.end (), uint8_t(PENDING_COLOR | PENDING_DEPTH));
+
+                reset_hi_z ();
+            }
+
+            void reset_hi_z ()
+            {
+                std::fill (hi_z       .begin (), hi_z       .end (), Depth_Format::bound (Depth_Format::far_value ()));
+                std::fill (hi_z_writes.begin (), hi_z_writes.end (), 0);
+
+                for (auto & cache : worker_caches)
+                {
+                    cache.hi_z_statistics   = Hi_Z_Statistics();
+                    cache.color_writes      = 0;
+                    cache.raster_statistics = Raster_Statistics();
+
+                    std::fill (cache.query_samples.begin (), cache.query_samples.end (), 0);
+                }
+
+                triangle_statistics = Triangle_Statistics();
+
+                first_serial = polygon_serial;
+
+                if (statistics) std::fill (overdraw.begin (), overdraw.end (), uint16_t(0));
+            }
+
+            bool is_hidden_by_hi_z
+            (
+                const Point4i * const vertices, 
+                const int     * const indices_begin, 
+                const int     * const indices_end,
+                const Surface &       surface,
+                      int             clip_top,
+                      int             clip_bottom
+            )   const;
+
+            void count_hi_z_writes (int column, int row, int written)
+            {
+                if ((hi_z_writes[row * hi_z_columns + column] += uint8_t(written)) >= hi_z_refresh_writes)
+                {
+                    refresh_hi_z (column, row);
+                }
+            }
+
+            void refresh_hi_z (int column, int row);
+
+            /**
+             * @brief Limpia el bloque si sigue pendiente de un clear() diferido. Se tiene que llamar
+             * antes de leer o escribir cualquiera de sus pixels.
+             *
+             */
+            void resolve_pending_clear (Worker_Cache & cache, int column, int row)
+            {
+                uint8_t & pending = pending_clears[row * hi_z_columns + column];
+
+                if (pending)
+                {
+                    clear_block (cache, column, row, pending);
+                    pending = 0;
+                }
+            }
+
+            void resolve_span_clears (Worker_Cache & cache, int y, int x_begin, int x_end)
+            {
+                for (int column = x_begin / block_size, last = (x_end - 1) / block_size; column <= last; ++column)
+                {
+                    resolve_pending_clear (cache, column, y / block_size);
+                }
+            }
+
+            void resolve_pending_clears (Worker_Cache & cache, int clip_top, int clip_bottom, uint8_t mask);
+
+            void clear_block (Worker_Cache & cache, int column, int row, uint8_t mask);
+
+            void rasterize_polygon_z_buffer
+            (
+                      Worker_Cache &       cache,
+                const Point4i    * const vertices, 
+                const int        * const indices_begin, 
+                const int        * const indices_end,
+                const Surface    &       surface,
+                      int                clip_top,
+                      int                clip_bottom
+            );
+
+            void rasterize_polygon_scanline
+            (
+                      Worker_Cache &       cache,
+                const Point4i    * const vertices, 
+                const int        * const indices_begin, 
+                const int        * const indices_end,
+                const Surface    &       surface,
+                      int                clip_top,
+                      int                clip_bottom
+            );
+
+            void rasterize_triangle_half_space
+            (
+                      Worker_Cache & cache,
+                const Point4i & v0,
+                const Point4i & v1,
+                const Point4i & v2,
+                const Surface & surface,
+                      int       clip_top,
+                      int       clip_bottom
+            );
+
+            /**
+             * @brief Calcula la cobertura de un triángulo de área no nula cuyo rectángulo envolvente no
+             * supera stamp_size pixels de lado. Devuelve false si no cubre ningún pixel.
+             *
+             */
+            static bool setup_stamp (const Point4i & v0, const Point4i & v1, const Point4i & v2, Stamp & stamp);
+
+            static bool is_stamp_sized (const Point4i & v0, const Point4i & v1, const Point4i & v2)
+            {
+                return
+                (
+                    std::max ({ v0[0], v1[0], v2[0] }) - int64_t(std::min ({ v0[0], v1[0], v2[0] })) <= stamp_size * subpixel_size &&
+                    std::max ({ v0[1], v1[1], v2[1] }) - int64_t(std::min ({ v0[1], v1[1], v2[1] })) <= stamp_size * subpixel_size
+                );
+            }
+
+            void rasterize_triangle_stamp
+            (
+                      Worker_Cache & cache,
+                const Stamp   & stamp,
+                const Surface & surface,
+                      int       clip_top,
+                      int       clip_bottom
+            );
+
+            void fill_span_z_buffer (Worker_Cache & cache, int y, int x_begin, int x_end, int z, int z_step, const Surface & surface);
+
+            /**
+             * @brief Primer y último pixel (o scanline) cuyo centro no queda antes o después de una
+             * coordenada en subpixels, y centro de un pixel en subpixels
+             *
+             */
+            static int first_pixel (int64_t coordinate)
+            {
+                return (int((coordinate + subpixel_size / 2 - 1) >> subpixel_bits));
+            }
+
+            static int last_pixel (int64_t coordinate)
+            {
+                return (int((coordinate - subpixel_size / 2) >> subpixel_bits));
+            }
+
+            static int64_t pixel_center (int pixel)
+            {
+                return (int64_t(pixel) * subpixel_size + subpixel_size / 2);
+            }
+
+            static int64_t floor_divide (int64_t dividend, int64_t divisor)
+            {
+                int64_t quotient = dividend / divisor;
+
+                return (dividend % divisor < 0 ? quotient - 1 : quotient);
+            }
+
+            void interpolate_x (int * cache, int x0, int x1, int y0, int y1, int row_limit);
+            void interpolate_z (int * cache, int z0, int z1, int y0, int y1, int row_limit);
+
+        };
+
+        // Definiciones de las constantes, necesarias cuando se pasan por referencia (std::min, etc.):
+
+        template< class  COLOR_BUFFER_TYPE, Raster_Engine ENGINE, class DEPTH_FORMAT > const int Rasterizer< COLOR_BUFFER_TYPE, ENGINE, DEPTH_FORMAT >::tile_rows;
+        template< class  COLOR_BUFFER_TYPE, Raster_Engine ENGINE, class DEPTH_FORMAT > const int Rasterizer< COLOR_BUFFER_TYPE, ENGINE, DEPTH_FORMAT >::block_size;
+        template< class  COLOR_BUFFER_TYPE, Raster_Engine ENGINE, class DEPTH_FORMAT > const int Rasterizer< COLOR_BUFFER_TYPE, ENGINE, DEPTH_FORMAT >::stamp_size;
+        template< class  COLOR_BUFFER_TYPE, Raster_Engine ENGINE, class DEPTH_FORMAT > const int Rasterizer< COLOR_BUFFER_TYPE, ENGINE, DEPTH_FORMAT >::guard_band_limit;
+        template< class  COLOR_BUFFER_TYPE, Raster_Engine ENGINE, class DEPTH_FORMAT > const int Rasterizer< COLOR_BUFFER_TYPE, ENGINE, DEPTH_FORMAT >::subpixel_bits;
+        template< class  COLOR_BUFFER_TYPE, Raster_Engine ENGINE, class DEPTH_FORMAT > const int Rasterizer< COLOR_BUFFER_TYPE, ENGINE, DEPTH_FORMAT >::subpixel_size;
+        template< class  COLOR_BUFFER_TYPE, Raster_Engine ENGINE, class DEPTH_FORMAT > const int Rasterizer< COLOR_BUFFER_TYPE, ENGINE, DEPTH_FORMAT >::hi_z_refresh_writes;
+        template< class  COLOR_BUFFER_TYPE, Raster_Engine ENGINE, class DEPTH_FORMAT > const int Rasterizer< COLOR_BUFFER_TYPE, ENGINE, DEPTH_FORMAT >::no_query;
+        template< class  COLOR_BUFFER_TYPE, Raster_Engine ENGINE, class DEPTH_FORMAT > const uint32_t Rasterizer< COLOR_BUFFER_TYPE, ENGINE, DEPTH_FORMAT >::no_owner;
+        template< class  COLOR_BUFFER_TYPE, Raster_Engine ENGINE, class DEPTH_FORMAT > const bool Rasterizer< COLOR_BUFFER_TYPE, ENGINE, DEPTH_FORMAT >::native_depth;
+        template< class  COLOR_BUFFER_TYPE, Raster_Engine ENGINE, class DEPTH_FORMAT > const bool Rasterizer< COLOR_BUFFER_TYPE, ENGINE, DEPTH_FORMAT >::statistics;
+        template< class  COLOR_BUFFER_TYPE, Raster_Engine ENGINE, class DEPTH_FORMAT > const size_t Rasterizer< COLOR_BUFFER_TYPE, ENGINE, DEPTH_FORMAT >::streaming_clear_bytes;
+        template< class  COLOR_BUFFER_TYPE, Raster_Engine ENGINE, class DEPTH_FORMAT > const size_t Rasterizer< COLOR_BUFFER_TYPE, ENGINE, DEPTH_FORMAT >::clear_job_bytes;
+        template< class  COLOR_BUFFER_TYPE, Raster_Engine ENGINE, class DEPTH_FORMAT > const int Rasterizer< COLOR_BUFFER_TYPE, ENGINE, DEPTH_FORMAT >::triangle_bits;
+        template< class  COLOR_BUFFER_TYPE, Raster_Engine ENGINE, class DEPTH_FORMAT > const uint32_t Rasterizer< COLOR_BUFFER_TYPE, ENGINE, DEPTH_FORMAT >::no_primitive;
+
+        template< class  COLOR_BUFFER_TYPE, Raster_Engine ENGINE, class DEPTH_FORMAT >
+        void Rasterizer< COLOR_BUFFER_TYPE, ENGINE, DEPTH_FORMAT >::fill_convex_polygon
+        (
+            const Point4i * const vertices, 
+            const int     * const indices_begin, 
+            const int     * const indices_end
+        )
+        {
+            // Se cachean algunos valores de interés:
+
+                  int    width         = int(color_buffer.get_width  ());
+                  int    height        = int(color_buffer.get_height ());
+                  int  * x_cache0      = worker_caches[0].x_cache0 ();
+                  int  * x_cache1      = worker_caches[0].x_cache1 ();
+            const int  * indices_back  = indices_end - 1;
+
+            // Se busca el vértice de inicio (el que tiene menor Y) y el de terminación (el que tiene mayor Y):
+
+            const int * start_index   = indices_begin;
+                  int   start_y       = vertices[*start_index].coordinates ()[1];
+            const int * end_index     = indices_begin;
+                  int   end_y         = start_y;
+
+            for (const int * index_iterator = start_index; ++index_iterator < indices_end; )
+            {
+                int current_y = vertices[*index_iterator].coordinates ()[1];
+
+                if (current_y < start_y)
+                {
+                    start_y     = current_y; 
+                    start_index = index_iterator;
+                }
+                else
+                if (current_y > end_y)
+                {
+                    end_y       = current_y;
+                    end_index   = index_iterator;
+                }
+            }
+
+            // Se cachean las coordenadas X de los lados que van desde el vértice con Y menor al
+            // vértice con Y mayor en sentido antihorario:
+
+            const int * current_index = start_index;
+            const int *    next_index = start_index > indices_begin ? start_index - 1 : indices_back;
+
+            int y0 = vertices[*current_index].coordinates ()[1];
+            int y1 = vertices[*   next_index].coordinates ()[1];
+            int x0 = vertices[*current_index].coordinates ()[0];
+            int x1 = vertices[*   next_index].coordinates ()[0];
+
+            while (true)
+            {
+                interpolate_x (x_cache0, x0, x1, y0, y1, height);
+
+                if (current_index == indices_begin) current_index = indices_back; else current_index--;
+                if (current_index == end_index    ) break;
+                if (   next_index == indices_begin) next_index    = indices_back; else    next_index--;
+
+                y0 = y1;
+                y1 = vertices[*next_index].coordinates ()[1];
+                x0 = x1;
+                x1 = vertices[*next_index].coordinates ()[0];
+            }
+
+            // Se cachean las coordenadas X de los lados que van desde el vértice con Y menor al
+            // vértice con Y mayor en sentido horario:
+
+            current_index = start_index;
+               next_index = start_index < indices_back ? start_index + 1 : indices_begin;
+
+            y0 = vertices[*current_index].coordinates ()[1];
+            y1 = vertices[*   next_index].coordinates ()[1];
+            x0 = vertices[*current_index].coordinates ()[0];
+            x1 = vertices[*   next_index].coordinates ()[0];
+
+            while (true)
+            {
+                interpolate_x (x_cache1, x0, x1, y0, y1, height);
+
+                if (current_index == indices_back) current_index = indices_begin; else current_index++;
+                if (current_index == end_index   ) break;
+                if (   next_index == indices_back) next_index    = indices_begin; else next_index++;
+
+                y0 = y1;
+                y1 = vertices[*next_index].coordinates ()[1];
+                x0 = x1;
+                x1 = vertices[*next_index].coordinates ()[0];
+            }
+
+            // Se rellenan las scanlines cuyo centro queda en [start_y, end_y), descartando las que quedan
+            // fuera de la pantalla y recortando cada span a su anchura:
+
+            for (int y = std::max (first_pixel (start_y), 0), last_y = std::min (first_pixel (end_y), height); y < last_y; y++)
+            {
+                x0 = std::max (std::min (x_cache0[y], x_cache1[y]), 0    );
+                x1 = std::min (std::max (x_cache0[y], x_cache1[y]), width);
+
+                if (x0 < x1) resolve_span_clears (worker_caches[0], y, x0, x1);
+
+                for (int x = x0, count; x < x1; x += count)
+                {
+                    count = contiguous_pixels (x, x1 - x);
+
+                    color_buffer.fill_span (pixel_offset (x, y), size_t(count));
+                }
+            }
+        }
+
+        template< class  COLOR_BUFFER_TYPE, Raster_Engine ENGINE, class DEPTH_FORMAT >
+        void Rasterizer< COLOR_BUFFER_TYPE, ENGINE, DEPTH_FORMAT >::fill_convex_polygon_z_buffer
+        (
+            const Point4i * const vertices, 
+            const int     * const indices_begin, 
+            const int     * const indices_end
+        )
+        {
+            submit_polygon (vertices, indices_begin, indices_end, current_surface (false));
+        }
+
+        template< class  COLOR_BUFFER_TYPE, Raster_Engine ENGINE, class DEPTH_FORMAT >
+        void Rasterizer< COLOR_BUFFER_TYPE, ENGINE, DEPTH_FORMAT >::fill_convex_polygon_depth
+        (
+            const Point4i * const vertices, 
+            const int     * const indices_begin, 
+            const int     * const indices_end
+        )
+        {
+            allocate_depth_owners ();
+
+            submit_polygon (vertices, indices_begin, indices_end, current_surface (true));
+        }
+
+        template< class  COLOR_BUFFER_TYPE, Raster_Engine ENGINE, class DEPTH_FORMAT >
+        void Rasterizer< COLOR_BUFFER_TYPE, ENGINE, DEPTH_FORMAT >::fill_triangles_z_buffer
+        (
+            const Point4i      * const vertices, 
+            const int          * const indices, 
+                  size_t               triangle_count,
+            const Color        * const colors,
+            const Primitive_Id * const ids
+        )
+        {
+            // La superficie se prepara una vez y de cada triángulo solo cambia el color o el identificador:
+
+            Surface surface = current_surface (false);
+
+            for (size_t triangle = 0; triangle < triangle_count; ++triangle)
+            {
+                if (visibility_mode) surface.id    = ids   [triangle];
+                else                 surface.color = colors[triangle];
+
+                submit_polygon (vertices, indices + 3 * triangle, indices + 3 * triangle + 3, surface);
+            }
+        }
+
+        template< class  COLOR_BUFFER_TYPE, Raster_Engine ENGINE, class DEPTH_FORMAT >
+        void Rasterizer< COLOR_BUFFER_TYPE, ENGINE, DEPTH_FORMAT >::fill_triangles_depth
+        (
+            const Point4i * const vertices, 
+            const int     * const indices, 
+                  size_t          triangle_count
+        )
+        {
+            Surface surface = current_surface (true);
+
+            allocate_depth_owners ();
+
+            for (size_t triangle = 0; triangle < triangle_count; ++triangle)
+            {
+                submit_polygon (vertices, indices + 3 * triangle, indices + 3 * triangle + 3, surface);
+            }
+        }
+
+        template< class  COLOR_BUFFER_TYPE, Raster_Engine ENGINE, class DEPTH_FORMAT >
+        void Rasterizer< COLOR_BUFFER_TYPE, ENGINE, DEPTH_FORMAT >::submit_polygon
+        (
+            const Point4i * const vertices, 
+            const int     * const indices_begin, 
+            const int     * const indices_end,
+                  Surface         surface
+        )
+        {
+            // Cada polígono se numera antes de descartar ninguno, para que la pasada previa de profundidad
+            // y la de igualdad asignen los mismos números:
+
+            surface.owner = polygon_serial++;
+
+            // Los triángulos de área nula y los pequeños que no cubren ningún pixel se descartan antes de
+            // repartirlos entre los tiles o de buscar sus lados:
+
+            if (indices_end - indices_begin == 3)
+            {
+                const Point4i & v0 = vertices[indices_begin[0]];
+                const Point4i & v1 = vertices[indices_begin[1]];
+                const Point4i & v2 = vertices[indices_begin[2]];
+
+                if (int64_t(v1[0] - v0[0]) * (v2[1] - v0[1]) == int64_t(v2[0] - v0[0]) * (v1[1] - v0[1]))
+                {
+                    triangle_statistics.degenerate++;
+                    return;
+                }
+
+                if (is_stamp_sized (v0, v1, v2))
+                {
+                    Stamp stamp;
+
+                    if (!setup_stamp (v0, v1, v2, stamp))
+                    {
+                        triangle_statistics.empty++;
+                        return;
+                    }
+
+                    triangle_statistics.small++;
+
+                    if (!worker_pool)
+                    {
+                        rasterize_triangle_stamp (worker_caches[0], stamp, surface, 0, int(color_buffer.get_height ()));
+                        return;
+                    }
+                }
+                else
+                {
+                    triangle_statistics.regular++;
+                }
+            }
+            else
+            {
+                triangle_statistics.regular++;
+            }
+
+            if (worker_pool)
+            {
+                bin_polygon (vertices, indices_begin, indices_end, surface);
+            }
+            else
+            {
+                rasterize_polygon_z_buffer
+                (
+                    worker_caches[0], vertices, indices_begin, indices_end, surface, 0, int(color_buffer.get_height ())
+                );
+            }
+        }
+
+        template< class  COLOR_BUFFER_TYPE, Raster_Engine ENGINE, class DEPTH_FORMAT >
+        void Rasterizer< COLOR_BUFFER_TYPE, ENGINE, DEPTH_FORMAT >::bin_polygon
+        (
+            const Point4i * const vertices, 
+            const int     * const indices_begin, 
+            const int     * const indices_end,
+            const Surface &       surface
+        )
+        {
+            // El polígono no puede escribir fuera de las scanlines cuyo centro queda entre la menor y la
+            // mayor Y de sus vértices:
+
+            int height = int(color_buffer.get_height ());
+            int y_min  = std::numeric_limits< int >::max ();
+            int y_max  = std::numeric_limits< int >::min ();
+
+            Binned_Polygon polygon;
+
+            polygon.first_vertex = binned_vertices.size ();
+            polygon.vertex_count = size_t(indices_end - indices_begin);
+            polygon.surface      = surface;
+
+            for (const int * index = indices_begin; index < indices_end; ++index)
+            {
+                const Point4i & vertex = vertices[*index];
+
+                y_min = std::min (y_min, vertex[1]);
+                y_max = std::max (y_max, vertex[1]);
+
+                binned_vertices.push_back (vertex);
+            }
+
+            y_min = first_pixel (y_min);
+            y_max = last_pixel  (y_max);
+
+            if (y_max < 0 || y_min >= height || y_min > y_max)
+            {
+                binned_vertices.resize (polygon.first_vertex);
+                return;
+            }
+
+            while (binned_indices.size () < polygon.vertex_count)
+            {
+                binned_indices.push_back (int(binned_indices.size ()));
+            }
+
+            int first_tile = std::max (y_min, 0) / tile_rows;
+            int last_tile  = std::min (y_max, height - 1) / tile_rows;
+
+            for (int tile = first_tile; tile <= last_tile; ++tile)
+            {
+                tile_bins[tile].push_back (binned_polygons.size ());
+            }
+
+            binned_polygons.push_back (polygon);
+        }
+
+        template< class  COLOR_BUFFER_TYPE, Raster_Engine ENGINE, class DEPTH_FORMAT >
+        void Rasterizer< COLOR_BUFFER_TYPE, ENGINE, DEPTH_FORMAT >::rasterize_polygon_z_buffer
+        (
+                  Worker_Cache &       cache,
+            const Point4i    * const vertices, 
+            const int        * const indices_begin, 
+            const int        * const indices_end,
+            const Surface    &       surface,
+                  int                clip_top,
+                  int                clip_bottom
+        )
+        {
+            if (indices_end - indices_begin == 3)
+            {
+                const Point4i & v0 = vertices[indices_begin[0]];
+                const Point4i & v1 = vertices[indices_begin[1]];
+                const Point4i & v2 = vertices[indices_begin[2]];
+
+                Stamp stamp;
+
+                if (is_stamp_sized (v0, v1, v2))
+                {
+                    if (setup_stamp (v0, v1, v2, stamp)) rasterize_triangle_stamp (cache, stamp, surface, clip_top, clip_bottom);
+                    return;
+                }
+            }
+
+            cache.hi_z_statistics.polygons_tested++;
+
+            if (is_hidden_by_hi_z (vertices, indices_begin, indices_end, surface, clip_top, clip_bottom))
+            {
+                cache.hi_z_statistics.polygons_rejected++;
+                return;
+            }
+
+            if (ENGINE == HALF_SPACE_ENGINE)
+            {
+                // Las funciones de arista se evalúan con enteros de 32 bits. Dentro del rectángulo
+                // envolvente (ampliado a bloques) no superan 2 * w * h + margin * (w + h) subpixels, lo
+                // que admite polígonos de hasta unos 2560x1440 pixels. Los mayores se rellenan por scanlines:
+
+                int64_t x_min = std::numeric_limits< int >::max (), x_max = std::numeric_limits< int >::min ();
+                int64_t y_min = x_min, y_max = x_max;
+
+                for (const int * index = indices_begin; index < indices_end; ++index)
+                {
+                    const Point4i & vertex = vertices[*index];
+
+                    x_min = std::min< int64_t > (x_min, vertex[0]);
+                    x_max = std::max< int64_t > (x_max, vertex[0]);
+                    y_min = std::min< int64_t > (y_min, vertex[1]);
+                    y_max = std::max< int64_t > (y_max, vertex[1]);
+                }
+
+                int64_t w      = x_max - x_min;
+                int64_t h      = y_max - y_min;
+                int64_t margin = int64_t(2 * block_size) * subpixel_size;
+
+                if (2 * w * h + margin * (w + h) <= std::numeric_limits< int32_t >::max ())
+                {
+                    // El polígono convexo se descompone en un abanico de triángulos:
+
+                    for (const int * index = indices_begin + 1; index + 1 < indices_end; ++index)
+                    {
+                        rasterize_triangle_half_space
+                        (
+                            cache, vertices[*indices_begin], vertices[index[0]], vertices[index[1]], surface, clip_top, clip_bottom
+                        );
+                    }
+
+                    return;
+                }
+            }
+
+            rasterize_polygon_scanline (cache, vertices, indices_begin, indices_end, surface, clip_top, clip_bottom);
+        }
+
+        template< class  COLOR_BUFFER_TYPE, Raster_Engine ENGINE, class DEPTH_FORMAT >
+        bool Rasterizer< COLOR_BUFFER_TYPE, ENGINE, DEPTH_FORMAT >::is_hidden_by_hi_z
+        (
+            const Point4i * const vertices, 
+            const int     * const indices_begin, 
+            const int     * const indices_end,
+            const Surface &       surface,
+                  int             clip_top,
+                  int             clip_bottom
+        )   const
+        {
+            int width  = int(color_buffer.get_width ());
+            int x_min  = std::numeric_limits< int >::max (), x_max = std::numeric_limits< int >::min ();
+            int y_min  = x_min, y_max = x_max;
+            int z_near = x_min;
+
+            for (const int * index = indices_begin; index < indices_end; ++index)
+            {
+                const Point4i & vertex = vertices[*index];
+
+                x_min  = std::min (x_min , vertex[0]);
+                x_max  = std::max (x_max , vertex[0]);
+                y_min  = std::min (y_min , vertex[1]);
+                y_max  = std::max (y_max , vertex[1]);
+                z_near = std::min (z_near, vertex[2]);
+            }
+
+            // Solo se comparan los bloques de los pixels cuyo centro queda en el rectángulo envolvente,
+            // dentro de la pantalla y de las scanlines [clip_top, clip_bottom):
+
+            x_min = std::max (first_pixel (x_min), 0);
+            x_max = std::min (last_pixel  (x_max), width - 1);
+            y_min = std::max (first_pixel (y_min), clip_top);
+            y_max = std::min (last_pixel  (y_max), clip_bottom - 1);
+
+            if (x_min > x_max || y_min > y_max) return (true);
+
+            // Se deja un margen para el redondeo de la Z por bloques de HALF_SPACE_ENGINE:
+
+            int64_t z_limit = int64_t(z_near) - block_size - hi_z_slack (surface);
+
+            for (int row = y_min / block_size; row <= y_max / block_size; ++row)
+            {
+                const int * block = hi_z.data () + row * hi_z_columns;
+
+                for (int column = x_min / block_size; column <= x_max / block_size; ++column)
+                {
+                    if (z_limit < block[column]) return (false);
+                }
+            }
+
+            return (true);
+        }
+
+        template< class  COLOR_BUFFER_TYPE, Raster_Engine ENGINE, class DEPTH_FORMAT >
+        bool Rasterizer< COLOR_BUFFER_TYPE, ENGINE, DEPTH_FORMAT >::is_rectangle_visible (int x_min, int y_min, int x_max, int y_max, int z)
+        {
+            flush ();
+
+            int width  = int(color_buffer.get_width  ());
+            int height = int(color_buffer.get_height ());
+
+            x_min = std::max (x_min, 0);
+            y_min = std::max (y_min, 0);
+            x_max = std::min (x_max, width  - 1);
+            y_max = std::min (y_max, height - 1);
+
+            if (x_min > x_max || y_min > y_max) return (false);
+
+            // Se descartan los bloques cuya Z jerárquica ya impide pasar el test y solo se lee el
+            // z_buffer de los demás, hasta encontrar el primer pixel que lo pasaría. Los bloques
+            // pendientes de un clear() diferido no se limpian, porque toda su Z es la lejana:
+
+            for (int row = y_min / block_size; row <= y_max / block_size; ++row)
+            {
+                for (int column = x_min / block_size; column <= x_max / block_size; ++column)
+                {
+                    int block = row * hi_z_columns + column;
+
+                    if (z >= hi_z[block]) continue;
+
+                    if (pending_clears[block] & PENDING_DEPTH)
+                    {
+                        if (Depth_Format::passes (z, Depth_Format::far_value ())) return (true);
+                        continue;
+                    }
+
+                    int x_begin = std::max (column * block_size, x_min);
+                    int x_end   = std::min (column * block_size + block_size - 1, x_max);
+                    int y_begin = std::max (row    * block_size, y_min);
+                    int y_end   = std::min (row    * block_size + block_size - 1, y_max);
+
+                    for (int y = y_begin; y <= y_end; ++y)
+                    {
+                        const Depth * depth = z_buffer.data () + pixel_offset (x_begin, y);
+
+                        for (int x = 0; x <= x_end - x_begin; ++x)
+                        {
+                            if (Depth_Format::passes (z, depth[x])) return (true);
+                        }
+                    }
+                }
+            }
+
+            return (false);
+        }
+
+        template< class  COLOR_BUFFER_TYPE, Raster_Engine ENGINE, class DEPTH_FORMAT >
+        void Rasterizer< COLOR_BUFFER_TYPE, ENGINE, DEPTH_FORMAT >::refresh_hi_z (int column, int row)
+        {
+            size_t width  = color_buffer.get_width ();
+            int    height = int(color_buffer.get_height ());
+
+            int x0     = column * block_size;
+            int y0     = row    * block_size;
+            int x1     = std::min (x0 + block_size, int(width));
+            int y1     = std::min (y0 + block_size, height);
+            int z_far  = std::numeric_limits< int >::min ();
+
+            if (native_depth && x1 - x0 == block_size)
+            {
+                Int32x8 z_max = Int32x8::broadcast (z_far);
+
+                for (int y = y0; y < y1; ++y)
+                {
+                    z_max = maximum (z_max, Int32x8::load (&z_buffer[pixel_offset (x0, y)]));
+                }
+
+                int32_t lanes[block_size];
+
+                z_max.store (lanes);
+
+                z_far = *std::max_element (lanes, lanes + block_size);
+            }
+            else
+            {
+                Depth depth_far = std::numeric_limits< Depth >::lowest ();
+
+                for (int y = y0; y < y1; ++y)
+                {
+                    const Depth * depth = &z_buffer[pixel_offset (x0, y)];
+
+                    depth_far = std::max (depth_far, *std::max_element (depth, depth + (x1 - x0)));
+                }
+
+                z_far = Depth_Format::bound (depth_far);
+            }
+
+            hi_z       [row * hi_z_columns + column] = z_far;
+            hi_z_writes[row * hi_z_columns + column] = 0;
+        }
+
+        template< class  COLOR_BUFFER_TYPE, Raster_Engine ENGINE, class DEPTH_FORMAT >
+        void Rasterizer< COLOR_BUFFER_TYPE, ENGINE, DEPTH_FORMAT >::resolve_pending_clears (Worker_Cache & cache, int clip_top, int clip_bottom, uint8_t mask)
+        {
+            for (int row = clip_top / block_size, last_row = (clip_bottom - 1) / block_size; row <= last_row; ++row)
+            {
+                uint8_t * pending = pending_clears.data () + row * hi_z_columns;
+
+                for (int column = 0; column < hi_z_columns; ++column)
+                {
+                    if (pending[column] & mask)
+                    {
+                        clear_block (cache, column, row, pending[column] & mask);
+                        pending[column] &= uint8_t(~mask);
+                    }
+                }
+            }
+        }
+
+        template< class  COLOR_BUFFER_TYPE, Raster_Engine ENGINE, class DEPTH_FORMAT >
+        void Rasterizer< COLOR_BUFFER_TYPE, ENGINE, DEPTH_FORMAT >::clear_block (Worker_Cache & cache, int column, int row, uint8_t mask)
+        {
+            size_t  width  = color_buffer.get_width ();
+            int     height = int(color_buffer.get_height ());
+            Color * colors = color_buffer.colors ();
+
+            int x0 = column * block_size;
+            int y0 = row    * block_size;
+            int x1 = std::min (x0 + block_size, int(width));
+            int y1 = std::min (y0 + block_size, height);
+
+            for (int y = y0; y < y1; ++y)
+            {
+                size_t begin = pixel_offset (x0, y);
+                size_t end   = begin + (x1 - x0);
+
+                if (mask & PENDING_COLOR)
+                {
+                    if (visibility_mode) std::fill (id_buffer.data () + begin, id_buffer.data () + end, no_primitive);
+                    else                 std::fill (colors + begin, colors + end, clear_color);
+                }
+
+                if (mask & PENDING_DEPTH) std::fill (z_buffer.data () + begin, z_buffer.data () + end, Depth_Format::far_value ());
+            }
+
+            if (statistics)
+            {
+                size_t pixels = size_t(x1 - x0) * size_t(y1 - y0);
+
+                if (mask & PENDING_COLOR) cache.raster_statistics.color_bytes_cleared += pixels * (visibility_mode ? sizeof(Primitive_Id) : sizeof(Color));
+                if (mask & PENDING_DEPTH) cache.raster_statistics.depth_bytes_cleared += pixels * sizeof(Depth);
+            }
+        }
+
+        template< class  COLOR_BUFFER_TYPE, Raster_Engine ENGINE, class DEPTH_FORMAT >
+        template< class SHADER >
+        void Rasterizer< COLOR_BUFFER_TYPE, ENGINE, DEPTH_FORMAT >::resolve_visibility (const SHADER & shader)
+        {
+            flush ();
+
+            if (!visibility_mode) return;
+
+            int height = int(color_buffer.get_height ());
+
+            if (worker_pool)
+            {
+                worker_pool->run
+                (
+                    tile_bins.size (),
+                    [this, height, &shader] (size_t tile, size_t)
+                    {
+                        int top = int(tile) * tile_rows;
 
-                y0 = y1;
-                y1 = vertices[*next_index].coordinates ()[1];
-                o0 = o1;
-                o1 = vertices[*next_index].coordinates ()[0] + y1 * pitch;
+                        resolve_visibility_rows (top, std::min (top + tile_rows, height), shader);
+                    }
+                );
             }
+            else
+            {
+                resolve_visibility_rows (0, height, shader);
+            }
+        }
 
-            if (o1 > end_offset) end_offset = o1;
+        template< class  COLOR_BUFFER_TYPE, Raster_Engine ENGINE, class DEPTH_FORMAT >
+        template< class SHADER >
+        void Rasterizer< COLOR_BUFFER_TYPE, ENGINE, DEPTH_FORMAT >::resolve_visibility_rows (int top, int bottom, const SHADER & shader)
+        {
+            size_t width = color_buffer.get_width ();
+            bool   tiled = color_buffer.is_tiled ();
 
-            // Se rellenan las scanlines desde la que tiene menor Y hasta la que tiene mayor Y:
+            // Cada scanline se recorre en tramos de pixels con el mismo identificador, de modo que el
+            // shader se evalúa una vez por tramo y el color se escribe de una vez. Con la disposición en
+            // tiles, las filas [top, bottom) ocupan tiles enteros y seguidos en memoria (tile_rows es
+            // múltiplo de su lado), así que los tramos pueden pasar de un tile al siguiente:
 
-            offset_cache0 += start_y;
-            offset_cache1 += start_y;
+            size_t begin = pixel_offset (0, top);
+            size_t end   = tiled && size_t(bottom) == color_buffer.get_height () ? id_buffer.size () : pixel_offset (0, bottom);
 
-            for (int y = start_y; y < end_y; y++)
+            for (size_t offset = begin; offset < end; )
             {
-                o0 = *offset_cache0++;
-                o1 = *offset_cache1++;
+                Primitive_Id id        = id_buffer[offset];
+                size_t       run_end   = offset + 1;
+                size_t       row_end   = tiled ? end : (offset / width + 1) * width;
 
-                if (o0 < o1)
-                {
-                    while (o0 < o1) color_buffer.set_pixel (o0++);
+                while (run_end < row_end && id_buffer[run_end] == id) ++run_end;
 
-                    if (o0 > end_offset) break;
-                }
-                else
-                {
-                    while (o1 < o0) color_buffer.set_pixel (o1++);
+                color_buffer.fill_span (offset, run_end - offset, id == no_primitive ? clear_color : Color(shader (id)));
 
-                    if (o1 > end_offset) break;
-                }
+                offset = run_end;
             }
         }
 
-        template< class  COLOR_BUFFER_TYPE >
-        void Rasterizer< COLOR_BUFFER_TYPE >::fill_convex_polygon_z_buffer
+        template< class  COLOR_BUFFER_TYPE, Raster_Engine ENGINE, class DEPTH_FORMAT >
+        void Rasterizer< COLOR_BUFFER_TYPE, ENGINE, DEPTH_FORMAT >::rasterize_polygon_scanline
         (
-            const Point4i * const vertices, 
-            const int     * const indices_begin, 
-            const int     * const indices_end
+                  Worker_Cache &       cache,
+            const Point4i    * const vertices, 
+            const int        * const indices_begin, 
+            const int        * const indices_end,
+            const Surface    &       surface,
+                  int                clip_top,
+                  int                clip_bottom
         )
         {
             // Se cachean algunos valores de interés:
 
-                  int   pitch         = color_buffer.get_width ();
-                  int * offset_cache0 = this->offset_cache0;
-                  int * offset_cache1 = this->offset_cache1;
-                  int * z_cache0      = this->z_cache0;
-                  int * z_cache1      = this->z_cache1;
+                  int   height        = int(color_buffer.get_height ());
+                  int * x_cache0      = cache.x_cache0 ();
+                  int * x_cache1      = cache.x_cache1 ();
+                  int * z_cache0      = cache.z_cache0 ();
+                  int * z_cache1      = cache.z_cache1 ();
             const int * indices_back  = indices_end - 1;
 
             // Se busca el vértice de inicio (el que tiene menor Y) y el de terminación (el que tiene mayor Y):
@@ -299,13 +2051,13 @@
             int y1 = vertices[*   next_index].coordinates ()[1];
             int z0 = vertices[*current_index].coordinates ()[2];
             int z1 = vertices[*   next_index].coordinates ()[2];
-            int o0 = vertices[*current_index].coordinates ()[0] + y0 * pitch;
-            int o1 = vertices[*   next_index].coordinates ()[0] + y1 * pitch;
+            int x0 = vertices[*current_index].coordinates ()[0];
+            int x1 = vertices[*   next_index].coordinates ()[0];
 
             while (true)
             {
-                interpolate< int64_t, 32 > (offset_cache0, o0, o1, y0, y1);
-                interpolate< int32_t,  0 > (     z_cache0, z0, z1, y0, y1);
+                interpolate_x (x_cache0, x0, x1, y0, y1, height);
+                interpolate_z (z_cache0, z0, z1, y0, y1, height);
 
                 if (current_index == indices_begin) current_index = indices_back; else current_index--;
                 if (current_index == end_index    ) break;
@@ -315,12 +2067,10 @@
                 y1 = vertices[*next_index].coordinates ()[1];
                 z0 = z1;
                 z1 = vertices[*next_index].coordinates ()[2];
-                o0 = o1;
-                o1 = vertices[*next_index].coordinates ()[0] + y1 * pitch;
+                x0 = x1;
+                x1 = vertices[*next_index].coordinates ()[0];
             }
 
-            int end_offset = o1;
-
             // Se cachean las coordenadas X de los lados que van desde el vértice con Y menor al
             // vértice con Y mayor en sentido horario:
 
@@ -331,13 +2081,13 @@
             y1 = vertices[*   next_index].coordinates ()[1];
             z0 = vertices[*current_index].coordinates ()[2];
             z1 = vertices[*   next_index].coordinates ()[2];
-            o0 = vertices[*current_index].coordinates ()[0] + y0 * pitch;
-            o1 = vertices[*   next_index].coordinates ()[0] + y1 * pitch;
+            x0 = vertices[*current_index].coordinates ()[0];
+            x1 = vertices[*   next_index].coordinates ()[0];
 
             while (true)
             {
-                interpolate< int64_t, 32 > (offset_cache1, o0, o1, y0, y1);
-                interpolate< int32_t,  0 > (     z_cache1, z0, z1, y0, y1);
+                interpolate_x (x_cache1, x0, x1, y0, y1, height);
+                interpolate_z (z_cache1, z0, z1, y0, y1, height);
 
                 if (current_index == indices_back) current_index = indices_begin; else current_index++;
                 if (current_index == end_index   ) break;
@@ -347,85 +2097,710 @@
                 y1 = vertices[*next_index].coordinates ()[1];
                 z0 = z1;
                 z1 = vertices[*next_index].coordinates ()[2];
-                o0 = o1;
-                o1 = vertices[*next_index].coordinates ()[0] + y1 * pitch;
+                x0 = x1;
+                x1 = vertices[*next_index].coordinates ()[0];
+            }
+
+            // Se rellenan las scanlines cuyo centro queda en [start_y, end_y), descartando las que quedan
+            // fuera del tramo [clip_top, clip_bottom):
+
+            for (int y = std::max (first_pixel (start_y), clip_top), last_y = std::min (first_pixel (end_y), clip_bottom); y < last_y; y++)
+            {
+                x0 = x_cache0[y];
+                x1 = x_cache1[y];
+                z0 = z_cache0[y];
+                z1 = z_cache1[y];
+
+                if (x0 < x1)
+                {
+                    int z_step = (z1 - z0) / (x1 - x0);
+
+                    fill_span_z_buffer (cache, y, x0, x1, z0, z_step, surface);
+                }
+                else
+                if (x1 < x0)
+                {
+                    int z_step = (z0 - z1) / (x0 - x1);
+
+                    fill_span_z_buffer (cache, y, x1, x0, z1, z_step, surface);
+                }
+            }
+        }
+
+        template< class  COLOR_BUFFER_TYPE, Raster_Engine ENGINE, class DEPTH_FORMAT >
+        bool Rasterizer< COLOR_BUFFER_TYPE, ENGINE, DEPTH_FORMAT >::setup_stamp
+        (
+            const Point4i & v0,
+            const Point4i & v1,
+            const Point4i & v2,
+                  Stamp & stamp
+        )
+        {
+            int64_t area = int64_t(v1[0] - v0[0]) * (v2[1] - v0[1]) - int64_t(v2[0] - v0[0]) * (v1[1] - v0[1]);
+
+            if (area == 0) return (false);
+
+            const Point4i * vertex[3] = { &v0, &v1, &v2 };
+
+            if (area < 0)
+            {
+                std::swap (vertex[1], vertex[2]);
+                area = -area;
+            }
+
+            // Solo pueden quedar dentro los pixels cuyo centro cae en el rectángulo envolvente. Se
+            // muestrean con las mismas funciones de arista y la misma regla que HALF_SPACE_ENGINE:
+
+            stamp.x       = first_pixel (std::min ({ v0[0], v1[0], v2[0] }));
+            stamp.y       = first_pixel (std::min ({ v0[1], v1[1], v2[1] }));
+            stamp.columns = last_pixel  (std::max ({ v0[0], v1[0], v2[0] })) - stamp.x + 1;
+            stamp.rows    = last_pixel  (std::max ({ v0[1], v1[1], v2[1] })) - stamp.y + 1;
+
+            if (stamp.columns <= 0 || stamp.rows <= 0) return (false);
+
+            int x_step[3];
+            int y_step[3];
+            int e_row [3];
+
+            for (int i = 0; i < 3; ++i)
+            {
+                const Point4i & a = *vertex[i];
+                const Point4i & b = *vertex[(i + 1) % 3];
+
+                int a_step = a[1] - b[1];
+                int b_step = b[0] - a[0];
+
+                e_row [i] = a_step * int(pixel_center (stamp.x) - a[0]) + b_step * int(pixel_center (stamp.y) - a[1]);
+                x_step[i] = a_step * subpixel_size;
+                y_step[i] = b_step * subpixel_size;
+
+                if (!(a_step > 0 || (a_step == 0 && b_step > 0))) e_row[i] -= 1;
+            }
+
+            uint32_t covered = 0;
+
+            for (int row = 0; row < stamp.rows; ++row)
+            {
+                uint32_t mask = 0;
+
+                for (int column = 0; column < stamp.columns; ++column)
+                {
+                    int e = 0;
+
+                    for (int i = 0; i < 3; ++i) e |= e_row[i] + x_step[i] * column;
+
+                    if (e >= 0) mask |= uint32_t(1) << column;
+                }
+
+                for (int i = 0; i < 3; ++i) e_row[i] += y_step[i];
+
+                stamp.coverage[row] = mask;
+                covered            |= mask;
+            }
+
+            if (covered == 0) return (false);
+
+            // Plano de profundidad, como en rasterize_triangle_half_space():
+
+            double dz1 = double((*vertex[1])[2]) - v0[2];
+            double dz2 = double((*vertex[2])[2]) - v0[2];
+            double dx1 = (*vertex[1])[0] - v0[0], dy1 = (*vertex[1])[1] - v0[1];
+            double dx2 = (*vertex[2])[0] - v0[0], dy2 = (*vertex[2])[1] - v0[1];
+
+            stamp.z_dx   = (dz1 * dy2 - dz2 * dy1) / double(area) * subpixel_size;
+            stamp.z_dy   = (dz2 * dx1 - dz1 * dx2) / double(area) * subpixel_size;
+            stamp.z      = v0[2] + stamp.z_dx * (stamp.x + 0.5 - double(v0[0]) / subpixel_size)
+                                 + stamp.z_dy * (stamp.y + 0.5 - double(v0[1]) / subpixel_size);
+            stamp.z_near = std::min ({ v0[2], v1[2], v2[2] });
+
+            return (true);
+        }
+
+        template< class  COLOR_BUFFER_TYPE, Raster_Engine ENGINE, class DEPTH_FORMAT >
+        void Rasterizer< COLOR_BUFFER_TYPE, ENGINE, DEPTH_FORMAT >::rasterize_triangle_stamp
+        (
+                  Worker_Cache & cache,
+            const Stamp   & stamp,
+            const Surface & surface,
+                  int       clip_top,
+                  int       clip_bottom
+        )
+        {
+            // Se recortan las filas y columnas del stamp a la pantalla y a las scanlines [clip_top, clip_bottom):
+
+            int width        = int(color_buffer.get_width ());
+            int row_begin    = std::max (stamp.y, clip_top) - stamp.y;
+            int row_end      = std::min (stamp.y + stamp.rows, clip_bottom) - stamp.y;
+            int column_begin = std::max (stamp.x, 0) - stamp.x;
+            int column_end   = std::min (stamp.x + stamp.columns, width) - stamp.x;
+
+            if (row_begin >= row_end || column_begin >= column_end) return;
+
+            int x_begin = stamp.x + column_begin;
+            int y_begin = stamp.y + row_begin;
+
+            // Un stamp ocupa como mucho 2x2 bloques, que se comparan con la Z jerárquica, se limpian
+            // antes de leerlos y llevan la cuenta de los pixels escritos en cada uno:
+
+            int     first_column  = x_begin / block_size;
+            int     first_row     = y_begin / block_size;
+            int     last_column   = (stamp.x + column_end - 1) / block_size;
+            int     last_row      = (stamp.y + row_end    - 1) / block_size;
+            int     written[2][2] = { { 0, 0 }, { 0, 0 } };
+            int64_t z_limit       = int64_t(stamp.z_near) - 1 - hi_z_slack (surface);
+            bool    hidden        = true;
+
+            for (int row = first_row; row <= last_row; ++row)
+            {
+                for (int column = first_column; column <= last_column; ++column)
+                {
+                    if (z_limit < hi_z[row * hi_z_columns + column]) hidden = false;
+                }
             }
 
-            if (o1 > end_offset) end_offset = o1;
+            cache.hi_z_statistics.polygons_tested++;
 
-            // Se rellenan las scanlines desde la que tiene menor Y hasta la que tiene mayor Y:
+            if (hidden)
+            {
+                cache.hi_z_statistics.polygons_rejected++;
+                return;
+            }
+
+            for (int row = first_row; row <= last_row; ++row)
+            {
+                for (int column = first_column; column <= last_column; ++column) resolve_pending_clear (cache, column, row);
+            }
+
+            bool equal_test  = surface.pass == PASS_EQUAL;
+            bool write_color = surface.pass != PASS_DEPTH_ONLY;
 
-            offset_cache0 += start_y;
-            offset_cache1 += start_y;
-            z_cache0 += start_y;
-            z_cache1 += start_y;
+            uint32_t columns = uint32_t(0xFFFFFFFF) >> (32 - (column_end - column_begin));
 
-            for (int y = start_y; y < end_y; y++)
+            for (int row = row_begin; row < row_end; ++row)
             {
-                o0 = *offset_cache0++;
-                o1 = *offset_cache1++;
-                z0 = *z_cache0++;
-                z1 = *z_cache1++;
+                uint32_t coverage = (stamp.coverage[row] >> column_begin) & columns;
+
+                if (coverage == 0) continue;
+
+                // Con la disposición en tiles, la fila puede continuar en el tile siguiente a partir
+                // de split:
+
+                int      y      = stamp.y + row;
+                int      tested = int(std::bitset< stamp_size + 1 >(coverage).count ());
+                int      count  = column_end - column_begin;
+                int      split  = contiguous_pixels (x_begin, count);
+                size_t   offset = pixel_offset (x_begin, y);
+                size_t   next   = split < count ? pixel_offset (x_begin + split, y) : offset + split;
+                uint32_t mask   = 0;
+
+                for (int column = column_begin; column < column_end; ++column, coverage >>= 1)
+                {
+                    if (!(coverage & 1)) continue;
+
+                    int     index = column - column_begin;
+                    int     z     = int(std::floor (stamp.z + stamp.z_dx * column + stamp.z_dy * row + 0.5));
+                    size_t  pixel = index < split ? offset + index : next + (index - split);
+                    Depth & depth = z_buffer[pixel];
+
+                    if (equal_test)
+                    {
+                        if (Depth_Format::store (z) == depth && owns_pixel (surface, pixel)) mask |= uint32_t(1) << index;
+                    }
+                    else
+                    if (Depth_Format::passes (z, depth))
+                    {
+                        depth = Depth_Format::store (z);
+                        claim_pixel (surface, pixel);
+                        mask |= uint32_t(1) << index;
+                        written[y / block_size - first_row][(x_begin + index) / block_size - first_column]++;
+                    }
+                }
+
+                if (statistics) count_depth_test (cache, tested, mask, surface);
+
+                if (mask == 0) continue;
+
+                count_query_samples (cache, mask, surface);
+
+                if (!write_color) continue;
+
+                uint32_t first = mask & (uint32_t(0xFFFFFFFF) >> (32 - split));
+                uint32_t last  = split < count ? mask >> split : 0;
+
+                if (first != 0) write_span_masked (cache, offset, size_t(split        ), first, surface);
+                if (last  != 0) write_span_masked (cache, next  , size_t(count - split), last , surface);
+            }
 
-                if (o0 < o1)
+            for (int row = first_row; row <= last_row; ++row)
+            {
+                for (int column = first_column; column <= last_column; ++column)
                 {
-                    int z_step = (z1 - z0) / (o1 - o0);
+                    int count = written[row - first_row][column - first_column];
+
+                    if (count) count_hi_z_writes (column, row, count);
+                }
+            }
+        }
+
+        template< class  COLOR_BUFFER_TYPE, Raster_Engine ENGINE, class DEPTH_FORMAT >
+        void Rasterizer< COLOR_BUFFER_TYPE, ENGINE, DEPTH_FORMAT >::fill_span_z_buffer
+        (
+            Worker_Cache & cache, int y, int x_begin, int x_end, int z, int z_step, const Surface & surface
+        )
+        {
+            // Se descarta la parte del span que queda fuera de la pantalla. La Z inicial se avanza como
+            // si se hubiesen recorrido los pixels descartados. Se extrapola en 64 bits y cada Z se satura
+            // a [0, depth_max] antes de usarla, porque lejos del triángulo puede salirse del rango de int:
+
+            int width = int(color_buffer.get_width ());
+
+            if (x_end > width) x_end = width;
+
+            if (std::max (x_begin, 0) >= x_end) return;
+
+            int64_t z_span = z;
+
+            if (x_begin < 0)
+            {
+                z_span += int64_t(z_step) * -x_begin;
+                x_begin = 0;
+            }
+
+            // Si la Z más cercana del span no mejora la Z más lejana de ninguno de los bloques de la Z
+            // jerárquica que atraviesa, se descarta sin leer el z_buffer:
+
+            int count     = x_end - x_begin;
+            int hi_z_row  = y / block_size;
+            int row_block = hi_z_row * hi_z_columns;
+            int z_near    = clamp_depth (z_step < 0 ? z_span + int64_t(z_step) * (count - 1) : z_span);
+            int z_far     = std::numeric_limits< int >::min ();
+
+            for (int block = row_block + x_begin / block_size, last = row_block + (x_end - 1) / block_size; block <= last; ++block)
+            {
+                z_far = std::max (z_far, hi_z[block]);
+            }
+
+            if (z_near >= z_far + hi_z_slack (surface))
+            {
+                cache.hi_z_statistics.blocks_rejected++;
+                cache.hi_z_statistics.pixels_rejected += count;
+                return;
+            }
+
+            resolve_span_clears (cache, y, x_begin, x_end);
+
+            // Se hace el test de profundidad en tramos de hasta 32 pixels seguidos en memoria y el color
+            // de los que lo pasan se escribe de una vez:
+
+            bool written = false;
 
-                    while (o0 < o1)
+            for (int x = x_begin, chunk; count > 0; count -= chunk, x += chunk)
+            {
+                uint32_t mask   = 0;
+                size_t   offset = pixel_offset (x, y);
+
+                chunk = contiguous_pixels (x, std::min (count, 32));
+
+                if (surface.pass == PASS_EQUAL)
+                {
+                    for (int index = 0; index < chunk; ++index, z_span += z_step)
                     {
-                        if (z0 < z_buffer[o0])
+                        if (Depth_Format::store (clamp_depth (z_span)) == z_buffer[offset + index] && owns_pixel (surface, offset + index))
                         {
-                            color_buffer.set_pixel (o0);
-                            z_buffer[o0] = z0;
+                            mask |= uint32_t(1) << index;
                         }
+                    }
+                }
+                else
+                {
+                    for (int index = 0; index < chunk; ++index, z_span += z_step)
+                    {
+                        int depth = clamp_depth (z_span);
 
-                        z0 += z_step;
-                        o0++;
+                        if (Depth_Format::passes (depth, z_buffer[offset + index]))
+                        {
+                            z_buffer[offset + index] = Depth_Format::store (depth);
+                            claim_pixel (surface, offset + index);
+                            mask |= uint32_t(1) << index;
+                        }
                     }
+                }
 
-                    if (o0 > end_offset) break;
+                if (statistics) count_depth_test (cache, chunk, mask, surface);
+
+                if (mask != 0)
+                {
+                    count_query_samples (cache, mask, surface);
+
+                    if (surface.pass != PASS_DEPTH_ONLY) write_span_masked (cache, offset, size_t(chunk), mask, surface);
+                    written = true;
                 }
-                else
-                if (o1 < o0)
+            }
+
+            // Se cuentan como escritos todos los pixels de un span que haya escrito alguno. Así la Z
+            // jerárquica de un bloque se recalcula algo antes de lo necesario, pero sin contar pixel a pixel:
+
+            if (written && surface.pass != PASS_EQUAL)
+            {
+                for (int x = x_begin; x < x_end; x = (x / block_size + 1) * block_size)
+                {
+                    count_hi_z_writes (x / block_size, hi_z_row, std::min ((x / block_size + 1) * block_size, x_end) - x);
+                }
+            }
+        }
+
+        template< class  COLOR_BUFFER_TYPE, Raster_Engine ENGINE, class DEPTH_FORMAT >
+        void Rasterizer< COLOR_BUFFER_TYPE, ENGINE, DEPTH_FORMAT >::rasterize_triangle_half_space
+        (
+                  Worker_Cache & cache,
+            const Point4i & v0,
+            const Point4i & v1,
+            const Point4i & v2,
+            const Surface & surface,
+                  int       clip_top,
+                  int       clip_bottom
+        )
+        {
+            // Se ordenan los vértices para que el área sea positiva:
+
+            int64_t area = int64_t(v1[0] - v0[0]) * (v2[1] - v0[1]) - int64_t(v2[0] - v0[0]) * (v1[1] - v0[1]);
+
+            if (area == 0) return;
+
+            const Point4i * vertex[3] = { &v0, &v1, &v2 };
+
+            if (area < 0)
+            {
+                std::swap (vertex[1], vertex[2]);
+                area = -area;
+            }
+
+            // Se calcula el rectángulo de los pixels cuyo centro queda en el rectángulo envolvente,
+            // recortado a la pantalla y a las scanlines [clip_top, clip_bottom):
+
+            int width  = int(color_buffer.get_width ());
+            int x_min  = std::max (first_pixel (std::min ({ v0[0], v1[0], v2[0] })), 0);
+            int x_max  = std::min (last_pixel  (std::max ({ v0[0], v1[0], v2[0] })), width - 1);
+            int y_min  = std::max (first_pixel (std::min ({ v0[1], v1[1], v2[1] })), clip_top);
+            int y_max  = std::min (last_pixel  (std::max ({ v0[1], v1[1], v2[1] })), clip_bottom - 1);
+
+            if (x_min > x_max || y_min > y_max) return;
+
+            // Cada arista a->b define la función E(x, y) = a_step * (x - ax) + b_step * (y - ay), que es
+            // positiva en el lado interior. Se evalúa en subpixels en el centro de cada pixel y los que
+            // caen justo sobre una arista solo se pintan si es izquierda u horizontal de menor Y, de modo
+            // que las aristas compartidas no se pintan dos veces. x_step e y_step avanzan un pixel:
+
+            int bx0 = x_min & ~(block_size - 1);
+            int by0 = y_min & ~(block_size - 1);
+
+            int     x_step  [3];
+            int     y_step  [3];
+            int     e_origin[3];
+            Int32x8 x_ramp  [3];
+
+            for (int i = 0; i < 3; ++i)
+            {
+                const Point4i & a = *vertex[i];
+                const Point4i & b = *vertex[(i + 1) % 3];
+
+                int64_t a_step = int64_t(a[1]) - b[1];
+                int64_t b_step = int64_t(b[0]) - a[0];
+                int64_t e      = a_step * (pixel_center (bx0) - a[0]) + b_step * (pixel_center (by0) - a[1]);
+
+                if (!(a_step > 0 || (a_step == 0 && b_step > 0))) e -= 1;
+
+                x_step  [i] = int(a_step * subpixel_size);
+                y_step  [i] = int(b_step * subpixel_size);
+                e_origin[i] = int(e);
+
+                int s = x_step[i];
+
+                x_ramp[i] = Int32x8::set (0, s, 2 * s, 3 * s, 4 * s, 5 * s, 6 * s, 7 * s);
+            }
+
+            // Plano de profundidad. La Z de cada lane se calcula con aritmética modular de 32 bits para
+            // que sea exacta en los pixels cubiertos aunque se salga de rango en los descartados:
+
+            double z0     = v0[2];
+            double dz1    = double((*vertex[1])[2]) - z0;
+            double dz2    = double((*vertex[2])[2]) - z0;
+            double dx1    = (*vertex[1])[0] - v0[0], dy1 = (*vertex[1])[1] - v0[1];
+            double dx2    = (*vertex[2])[0] - v0[0], dy2 = (*vertex[2])[1] - v0[1];
+            double z_dx   = (dz1 * dy2 - dz2 * dy1) / double(area) * subpixel_size;
+            double z_dy   = (dz2 * dx1 - dz1 * dx2) / double(area) * subpixel_size;
+            double x0     = double(v0[0]) / subpixel_size - 0.5;
+            double y0     = double(v0[1]) / subpixel_size - 0.5;
+
+            int32_t z_lanes[block_size];
+
+            for (int i = 0; i < block_size; ++i) z_lanes[i] = int32_t(uint32_t(int64_t(std::floor (z_dx * i + 0.5))));
+
+            int32_t z_row_step = int32_t(uint32_t(int64_t(std::floor (z_dy + 0.5))));
+            Int32x8 z_ramp     = Int32x8::load (z_lanes);
+            bool    equal_test  = surface.pass == PASS_EQUAL;
+            bool    write_color = surface.pass != PASS_DEPTH_ONLY;
+            bool    depth_only  = surface.pass == PASS_DEPTH_ONLY;
+            Int32x8 minus1     = Int32x8::broadcast (-1);
+            Int32x8 owner      = Int32x8::broadcast (int32_t(surface.owner));
+
+            // Sin pasada previa de profundidad no hay propietarios que comprobar:
+
+            uint32_t * owners = depth_owners.empty () ? nullptr : depth_owners.data ();
+            Int32x8 y_steps[3] =
+            {
+                Int32x8::broadcast (y_step[0]), Int32x8::broadcast (y_step[1]), Int32x8::broadcast (y_step[2])
+            };
+
+            for (int by = by0; by <= y_max; by += block_size)
+            {
+                int row_begin = std::max (by, y_min);
+                int row_end   = std::min (by + block_size - 1, y_max);
+
+                for (int bx = bx0; bx <= x_max; bx += block_size)
                 {
-                    int z_step = (z0 - z1) / (o0 - o1);
+                    // Se evalúan las aristas en las esquinas del bloque para descartarlo entero o para
+                    // saltarse el test de cobertura si queda dentro del triángulo por completo:
+
+                    int  e[3];
+                    bool outside = false;
+                    bool inside  = true;
 
-                    while (o1 < o0)
+                    for (int i = 0; i < 3; ++i)
                     {
-                        if (z1 < z_buffer[o1])
+                        int dx = x_step[i] * (block_size - 1);
+                        int dy = y_step[i] * (block_size - 1);
+
+                        e[i] = e_origin[i] + x_step[i] * (bx - bx0) + y_step[i] * (by - by0);
+
+                        if (e[i] + std::max (dx, 0) + std::max (dy, 0) < 0) outside = true;
+                        if (e[i] + std::min (dx, 0) + std::min (dy, 0) < 0) inside  = false;
+
+                        e[i] += y_step[i] * (row_begin - by);
+                    }
+
+                    if (outside) continue;
+
+                    // La Z se redondea una vez por bloque y avanza con pasos enteros entre scanlines. Si ni
+                    // la esquina más cercana del bloque mejora la Z jerárquica, no se visita ningún pixel:
+
+                    double  z_block = z0 + z_dx * (bx - x0) + z_dy * (row_begin - y0);
+                    double  z_near  = z_block + std::min (z_dx * (block_size - 1), 0.0) + std::min (z_dy * (row_end - row_begin), 0.0);
+                    int     block   = (by / block_size) * hi_z_columns + bx / block_size;
+
+                    if (z_near - block_size >= double(hi_z[block] + hi_z_slack (surface)))
+                    {
+                        cache.hi_z_statistics.blocks_rejected++;
+                        cache.hi_z_statistics.pixels_rejected += (row_end - row_begin + 1) * std::min (block_size, width - bx);
+                        continue;
+                    }
+
+                    resolve_pending_clear (cache, bx / block_size, by / block_size);
+
+                    int32_t z       = int32_t(uint32_t(int64_t(std::floor (z_block + 0.5))));
+                    size_t  offset  = pixel_offset (bx, row_begin);
+                    size_t  pitch   = row_pitch ();
+                    int     written = 0;
+
+                    if (bx + block_size > width)
+                    {
+                        int lanes = width - bx;
+
+                        for (int y = row_begin; y <= row_end; ++y, offset += pitch, z = int32_t(uint32_t(z) + uint32_t(z_row_step)))
+                        {
+                            uint32_t mask   = 0;
+                            int      tested = 0;
+
+                            for (int lane = 0; lane < lanes; ++lane)
+                            {
+                                int covered = 0;
+                                int z_lane  = int32_t(uint32_t(z) + uint32_t(z_lanes[lane]));
+
+                                for (int i = 0; i < 3; ++i) covered |= e[i] + y_step[i] * (y - row_begin) + x_step[i] * lane;
+
+                                if (covered < 0) continue;
+
+                                tested++;
+
+                                if (equal_test)
+                                {
+                                    if (Depth_Format::store (z_lane) == z_buffer[offset + lane] && owns_pixel (surface, offset + lane)) mask |= uint32_t(1) << lane;
+                                }
+                                else
+                                if (Depth_Format::passes (z_lane, z_buffer[offset + lane]))
+                                {
+                                    z_buffer[offset + lane] = Depth_Format::store (z_lane);
+                                    claim_pixel (surface, offset + lane);
+                                    mask |= uint32_t(1) << lane;
+                                    written++;
+                                }
+                            }
+
+                            if (statistics) count_depth_test (cache, tested, mask, surface);
+
+                            if (mask == 0) continue;
+
+                            count_query_samples (cache, mask, surface);
+
+                            if (write_color) write_span_masked (cache, offset, size_t(lanes), mask, surface);
+                        }
+
+                        if (written) count_hi_z_writes (bx / block_size, by / block_size, written);
+                        continue;
+                    }
+
+                    Int32x8 e0       = Int32x8::broadcast (e[0]) + x_ramp[0];
+                    Int32x8 e1       = Int32x8::broadcast (e[1]) + x_ramp[1];
+                    Int32x8 e2       = Int32x8::broadcast (e[2]) + x_ramp[2];
+                    Int32x8 z_vector = Int32x8::broadcast (z) + z_ramp;
+                    Int32x8 z_steps  = Int32x8::broadcast (z_row_step);
+
+                    for (int y = row_begin; y <= row_end; ++y, offset += pitch)
+                    {
+                        Int32x8 coverage = minus1;
+
+                        if (!inside)
                         {
-                            color_buffer.set_pixel (o1);
-                            z_buffer[o1] = z1;
+                            coverage = greater (e0 | e1 | e2, minus1);
+
+                            e0 = e0 + y_steps[0];
+                            e1 = e1 + y_steps[1];
+                            e2 = e2 + y_steps[2];
+                        }
+
+                        int mask = 0;
+
+                        if (native_depth)
+                        {
+                            Int32x8 depth = Int32x8::load (z_buffer.data () + offset);
+
+                            if (equal_test)
+                            {
+                                Int32x8 pass = coverage & equal (depth, z_vector);
+
+                                if (owners) pass = pass & equal (Int32x8::load (owners + offset), owner);
+
+                                mask = pass.mask ();
+                            }
+                            else
+                            {
+                                Int32x8 pass = coverage & greater (depth, z_vector);
+
+                                mask = pass.mask ();
+
+                                if (mask != 0)
+                                {
+                                    select (pass, z_vector, depth).store (z_buffer.data () + offset);
+
+                                    if (depth_only) select (pass, owner, Int32x8::load (owners + offset)).store (owners + offset);
+                                }
+                            }
+                        }
+                        else
+                        {
+                            // El resto de formatos se comparan y se escriben pixel a pixel:
+
+                            int32_t z_values[block_size];
+                            int     covered = coverage.mask ();
+
+                            z_vector.store (z_values);
+
+                            for (int lane = 0; lane < block_size; ++lane)
+                            {
+                                if (!(covered & (1 << lane))) continue;
+
+                                if (equal_test)
+                                {
+                                    if (Depth_Format::store (z_values[lane]) == z_buffer[offset + lane] && owns_pixel (surface, offset + lane)) mask |= 1 << lane;
+                                }
+                                else
+                                if (Depth_Format::passes (z_values[lane], z_buffer[offset + lane]))
+                                {
+                                    z_buffer[offset + lane] = Depth_Format::store (z_values[lane]);
+                                    claim_pixel (surface, offset + lane);
+                                    mask |= 1 << lane;
+                                }
+                            }
+                        }
+
+                        if (statistics) count_depth_test (cache, int(std::bitset< block_size >(coverage.mask ()).count ()), uint32_t(mask), surface, native_depth ? block_size : 0);
+
+                        if (mask != 0)
+                        {
+                            count_query_samples (cache, uint32_t(mask), surface);
+
+                            if (!equal_test) written += int(std::bitset< block_size >(mask).count ());
+                            if (write_color) write_span_masked (cache, offset, block_size, uint32_t(mask), surface);
                         }
 
-                        z1 += z_step;
-                        o1++;
+                        z_vector = z_vector + z_steps;
                     }
 
-                    if (o1 > end_offset) break;
+                    if (written) count_hi_z_writes (bx / block_size, by / block_size, written);
                 }
             }
         }
 
-        template< class  COLOR_BUFFER_TYPE >
-        template< typename VALUE_TYPE, size_t SHIFT >
-        void Rasterizer< COLOR_BUFFER_TYPE >::interpolate (int * cache, int v0, int v1, int y_min, int y_max)
+        template< class  COLOR_BUFFER_TYPE, Raster_Engine ENGINE, class DEPTH_FORMAT >
+        void Rasterizer< COLOR_BUFFER_TYPE, ENGINE, DEPTH_FORMAT >::interpolate_x (int * cache, int x0, int x1, int y0, int y1, int row_limit)
         {
-            if (y_max > y_min)
+            // Solo se escriben las entradas de las scanlines [0, row_limit) cuyo centro queda en [y0, y1):
+
+            int first = std::max (first_pixel (y0), 0);
+            int last  = std::min (first_pixel (y1), row_limit);
+
+            if (first >= last) return;
+
+            // En cada scanline se guarda el primer pixel cuyo centro no queda a la izquierda del lado,
+            // ceil (numerator / denominator). El cociente avanza con su resto exacto, de modo que dos
+            // polígonos que comparten un lado se reparten sus pixels sin huecos ni solapes:
+
+            int64_t dy          = int64_t(y1) - y0;
+            int64_t dx          = int64_t(x1) - x0;
+            int64_t denominator = dy * subpixel_size;
+            int64_t numerator   = (int64_t(x0) - subpixel_size / 2) * dy + dx * (pixel_center (first) - y0);
+            int64_t x           = -floor_divide (-numerator, denominator);
+            int64_t remainder   = x * denominator - numerator;
+            int64_t advance     = dx * subpixel_size;
+            int64_t step        = floor_divide (advance, denominator);
+            int64_t excess      = advance - step * denominator;
+
+            for (int * iterator = cache + first, * end = cache + last; iterator < end; ++iterator)
             {
-                VALUE_TYPE value = (VALUE_TYPE(     v0) << SHIFT);
-                VALUE_TYPE step  = (VALUE_TYPE(v1 - v0) << SHIFT) / (y_max - y_min);
+               *iterator   = int(x);
+                x         += step;
+                remainder -= excess;
 
-                for (int * iterator = cache + y_min, * end = cache + y_max; iterator <= end; )
+                if (remainder < 0)
                 {
-                   *iterator++ = int(value >> SHIFT);
-                    value += step;
-                   *iterator++ = int(value >> SHIFT);
-                    value += step;
+                    x++;
+                    remainder += denominator;
                 }
             }
         }
 
+        template< class  COLOR_BUFFER_TYPE, Raster_Engine ENGINE, class DEPTH_FORMAT >
+        void Rasterizer< COLOR_BUFFER_TYPE, ENGINE, DEPTH_FORMAT >::interpolate_z (int * cache, int z0, int z1, int y0, int y1, int row_limit)
+        {
+            int first = std::max (first_pixel (y0), 0);
+            int last  = std::min (first_pixel (y1), row_limit);
+
+            if (first >= last) return;
+
+            // La Z de cada scanline se toma en el lado a la altura de su centro:
+
+            double dz   = double(z1) - z0;
+            double dy   = double(y1) - y0;
+            double step = dz * subpixel_size / dy;
+            double z    = z0 + dz * double(pixel_center (first) - y0) / dy;
+
+            for (int * iterator = cache + first, * end = cache + last; iterator < end; ++iterator)
+            {
+               *iterator = int(std::floor (z + 0.5));
+                z       += step;
+            }
+        }
+
     }
 
 #endif
@@ -0,0 +1,323 @@
+/**
+ * @file Simd.hpp
+ * @author Gonzalo Perez Chamarro
+ * @brief Vector de 8 enteros de 32 bits sobre AVX2, SSE2 o código escalar
+ * @version 0.1
+ * @date 2019-03-10
+ *
+ * @copyright Copyright (c) 2019
+ *
+ */
+
+#ifndef SIMD_HEADER
+#define SIMD_HEADER
+
+    #include <stdint.h>
+    #include <cstddef>
+    #include <cstring>
+
+    #if defined(__AVX2__)
+        #define SIMD_AVX2
+        #include <immintrin.h>
+    #elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+        #define SIMD_SSE2
+        #include <emmintrin.h>
+    #endif
+
+    namespace example
+    {
+
+        /**
+         * @brief Se usa un único registro de 256 bits con AVX2, dos de 128 bits con SSE2 y un array en
+         * cualquier otro caso. Las cargas y los almacenamientos no necesitan alineación.
+         *
+         */
+        struct Int32x8
+        {
+            #if defined(SIMD_AVX2)
+                __m256i value;
+            #elif defined(SIMD_SSE2)
+                __m128i low, high;
+            #else
+                int32_t lane[8];
+            #endif
+
+            static Int32x8 broadcast (int32_t scalar)
+            {
+                Int32x8 result;
+
+                #if defined(SIMD_AVX2)
+                    result.value = _mm256_set1_epi32 (scalar);
+                #elif defined(SIMD_SSE2)
+                    result.low = result.high = _mm_set1_epi32 (scalar);
+                #else
+                    for (int i = 0; i < 8; ++i) result.lane[i] = scalar;
+                #endif
+
+                return (result);
+            }
+
+            static Int32x8 set (int32_t l0, int32_t l1, int32_t l2, int32_t l3, int32_t l4, int32_t l5, int32_t l6, int32_t l7)
+            {
+                Int32x8 result;
+
+                #if defined(SIMD_AVX2)
+                    result.value = _mm256_setr_epi32 (l0, l1, l2, l3, l4, l5, l6, l7);
+                #elif defined(SIMD_SSE2)
+                    result.low   = _mm_setr_epi32 (l0, l1, l2, l3);
+                    result.high  = _mm_setr_epi32 (l4, l5, l6, l7);
+                #else
+                    int32_t lanes[8] = { l0, l1, l2, l3, l4, l5, l6, l7 };
+                    for (int i = 0; i < 8; ++i) result.lane[i] = lanes[i];
+                #endif
+
+                return (result);
+            }
+
+            static Int32x8 load (const void * address)
+            {
+                Int32x8 result;
+
+                #if defined(SIMD_AVX2)
+                    result.value = _mm256_loadu_si256 (static_cast< const __m256i * >(address));
+                #elif defined(SIMD_SSE2)
+                    result.low   = _mm_loadu_si128 (static_cast< const __m128i * >(address) + 0);
+                    result.high  = _mm_loadu_si128 (static_cast< const __m128i * >(address) + 1);
+                #else
+                    for (int i = 0; i < 8; ++i) result.lane[i] = static_cast< const int32_t * >(address)[i];
+                #endif
+
+                return (result);
+            }
+
+            void store (void * address) const
+            {
+                #if defined(SIMD_AVX2)
+                    _mm256_storeu_si256 (static_cast< __m256i * >(address), value);
+                #elif defined(SIMD_SSE2)
+                    _mm_storeu_si128 (static_cast< __m128i * >(address) + 0, low );
+                    _mm_storeu_si128 (static_cast< __m128i * >(address) + 1, high);
+                #else
+                    for (int i = 0; i < 8; ++i) static_cast< int32_t * >(address)[i] = lane[i];
+                #endif
+            }
+
+            /**
+             * @brief Almacenamiento no temporal, que no pasa por la caché. La dirección tiene que estar
+             * alineada a 32 bytes y, antes de que otro hilo lea lo escrito, hay que llamar a stream_fence().
+             *
+             */
+            void stream (void * address) const
+            {
+                #if defined(SIMD_AVX2)
+                    _mm256_stream_si256 (static_cast< __m256i * >(address), value);
+                #elif defined(SIMD_SSE2)
+                    _mm_stream_si128 (static_cast< __m128i * >(address) + 0, low );
+                    _mm_stream_si128 (static_cast< __m128i * >(address) + 1, high);
+                #else
+                    store (address);
+                #endif
+            }
+
+            /**
+             * @brief Guarda las 8 lanes como 8 bytes consecutivos. Cada lane tiene que estar en [0, 255].
+             *
+             */
+            void store_bytes (uint8_t * address) const
+            {
+                #if defined(SIMD_AVX2)
+                    __m128i words = _mm_packs_epi32 (_mm256_castsi256_si128 (value), _mm256_extracti128_si256 (value, 1));
+                    _mm_storel_epi64 (reinterpret_cast< __m128i * >(address), _mm_packus_epi16 (words, words));
+                #elif defined(SIMD_SSE2)
+                    __m128i words = _mm_packs_epi32 (low, high);
+                    _mm_storel_epi64 (reinterpret_cast< __m128i * >(address), _mm_packus_epi16 (words, words));
+                #else
+                    for (int i = 0; i < 8; ++i) address[i] = uint8_t(lane[i]);
+                #endif
+            }
+
+            /**
+             * @brief Devuelve un bit por lane con el bit de signo de cada una
+             *
+             */
+            int mask () const
+            {
+                #if defined(SIMD_AVX2)
+                    return (_mm256_movemask_ps (_mm256_castsi256_ps (value)));
+                #elif defined(SIMD_SSE2)
+                    return (_mm_movemask_ps (_mm_castsi128_ps (low)) | _mm_movemask_ps (_mm_castsi128_ps (high)) << 4);
+                #else
+                    int result = 0;
+                    for (int i = 0; i < 8; ++i) result |= int(uint32_t(lane[i]) >> 31) << i;
+                    return (result);
+                #endif
+            }
+
+        };
+
+        #if defined(SIMD_AVX2)
+            #define SIMD_BINARY_OPERATION(NAME, AVX2, SSE2, SCALAR)                                             \
+                inline Int32x8 NAME (const Int32x8 & a, const Int32x8 & b)                                      \
+                {                                                                                               \
+                    Int32x8 result; result.value = AVX2 (a.value, b.value); return (result);                    \
+                }
+        #elif defined(SIMD_SSE2)
+            #define SIMD_BINARY_OPERATION(NAME, AVX2, SSE2, SCALAR)                                             \
+                inline Int32x8 NAME (const Int32x8 & a, const Int32x8 & b)                                      \
+                {                                                                                               \
+                    Int32x8 result; result.low = SSE2 (a.low, b.low); result.high = SSE2 (a.high, b.high);      \
+                    return (result);                                                                            \
+                }
+        #else
+            #define SIMD_BINARY_OPERATION(NAME, AVX2, SSE2, SCALAR)                                             \
+                inline Int32x8 NAME (const Int32x8 & a, const Int32x8 & b)                                      \
+                {                                                                                               \
+                    Int32x8 result;                                                                             \
+                    for (int i = 0; i < 8; ++i) { int32_t x = a.lane[i], y = b.lane[i]; result.lane[i] = SCALAR; } \
+                    return (result);                                                                            \
+                }
+        #endif
+
+        SIMD_BINARY_OPERATION (operator +, _mm256_add_epi32   , _mm_add_epi32   , int32_t(uint32_t(x) + uint32_t(y)))
+        SIMD_BINARY_OPERATION (operator &, _mm256_and_si256   , _mm_and_si128   , x & y)
+        SIMD_BINARY_OPERATION (operator |, _mm256_or_si256    , _mm_or_si128    , x | y)
+        SIMD_BINARY_OPERATION (and_not   , _mm256_andnot_si256, _mm_andnot_si128, ~x & y)
+        SIMD_BINARY_OPERATION (greater   , _mm256_cmpgt_epi32 , _mm_cmpgt_epi32 , x > y ? -1 : 0)
+        SIMD_BINARY_OPERATION (equal     , _mm256_cmpeq_epi32 , _mm_cmpeq_epi32 , x == y ? -1 : 0)
+
+        #undef SIMD_BINARY_OPERATION
+
+        /**
+         * @brief Producto de lanes que caben en 16 bits: las de a en [0, 32767] y las de b en
+         * [-32768, 32767]. Con esa condición basta la multiplicación de 16 bits de SSE2.
+         *
+         */
+        inline Int32x8 multiply_16 (const Int32x8 & a, const Int32x8 & b)
+        {
+            Int32x8 result;
+
+            #if defined(SIMD_AVX2)
+                result.value = _mm256_madd_epi16 (a.value, b.value);
+            #elif defined(SIMD_SSE2)
+                result.low   = _mm_madd_epi16 (a.low , b.low );
+                result.high  = _mm_madd_epi16 (a.high, b.high);
+            #else
+                for (int i = 0; i < 8; ++i) result.lane[i] = a.lane[i] * b.lane[i];
+            #endif
+
+            return (result);
+        }
+
+        /**
+         * @brief Desplazamiento lógico a la derecha (entran ceros) de todas las lanes
+         *
+         */
+        inline Int32x8 shift_right (const Int32x8 & a, int bits)
+        {
+            Int32x8 result;
+
+            #if defined(SIMD_AVX2)
+                result.value = _mm256_srl_epi32 (a.value, _mm_cvtsi32_si128 (bits));
+            #elif defined(SIMD_SSE2)
+                result.low   = _mm_srl_epi32 (a.low , _mm_cvtsi32_si128 (bits));
+                result.high  = _mm_srl_epi32 (a.high, _mm_cvtsi32_si128 (bits));
+            #else
+                for (int i = 0; i < 8; ++i) result.lane[i] = int32_t(uint32_t(a.lane[i]) >> bits);
+            #endif
+
+            return (result);
+        }
+
+        /**
+         * @brief Suma a cada lane par la lane impar que la sigue. Las lanes impares no cambian.
+         *
+         */
+        inline Int32x8 add_pairs (const Int32x8 & a)
+        {
+            Int32x8 result;
+
+            #if defined(SIMD_AVX2)
+                result.value = _mm256_add_epi32 (a.value, _mm256_srli_epi64 (a.value, 32));
+            #elif defined(SIMD_SSE2)
+                result.low   = _mm_add_epi32 (a.low , _mm_srli_epi64 (a.low , 32));
+                result.high  = _mm_add_epi32 (a.high, _mm_srli_epi64 (a.high, 32));
+            #else
+                for (int i = 0; i < 8; ++i) result.lane[i] = i % 2 ? a.lane[i] : int32_t(uint32_t(a.lane[i]) + uint32_t(a.lane[i + 1]));
+            #endif
+
+            return (result);
+        }
+
+        /**
+         * @brief Toma cada lane de a donde mask tiene todos los bits a 1 y de b en el resto
+         *
+         */
+        inline Int32x8 select (const Int32x8 & mask, const Int32x8 & a, const Int32x8 & b)
+        {
+            return ((mask & a) | and_not (mask, b));
+        }
+
+        inline Int32x8 maximum (const Int32x8 & a, const Int32x8 & b)
+        {
+            #if defined(SIMD_AVX2)
+                Int32x8 result; result.value = _mm256_max_epi32 (a.value, b.value); return (result);
+            #else
+                return (select (greater (a, b), a, b));
+            #endif
+        }
+
+        /**
+         * @brief Ordena los almacenamientos no temporales anteriores con los que vengan después
+         *
+         */
+        inline void stream_fence ()
+        {
+            #if defined(SIMD_AVX2) || defined(SIMD_SSE2)
+                _mm_sfence ();
+            #endif
+        }
+
+        /**
+         * @brief Escribe value en los count elementos de target, 32 bytes a la vez. T tiene que ocupar
+         * 2 o 4 bytes (un color o una Z), de modo que value repetido forma un patrón de 32 bits. Con
+         * streaming, el bloque alineado central se escribe sin pasar por la caché, lo que solo compensa
+         * si target no cabe en ella.
+         *
+         */
+        template< class T >
+        inline void fill_pattern (T * target, size_t count, const T & value, bool streaming)
+        {
+            static_assert (sizeof(T) == 2 || sizeof(T) == 4, "fill_pattern() escribe elementos de 2 o 4 bytes");
+
+            T * end = target + count;
+
+            // Los elementos hasta la primera dirección alineada a 32 bytes se escriben uno a uno:
+
+            while (target < end && (reinterpret_cast< uintptr_t >(target) & 31) != 0) *target++ = value;
+
+            uint32_t pattern = 0;
+
+            std::memcpy (&pattern, &value, sizeof(T));
+
+            if (sizeof(T) == 2) pattern |= pattern << 16;
+
+            Int32x8 vector = Int32x8::broadcast (int32_t(pattern));
+            T     * last   = target + (size_t(end - target) & ~(32 / sizeof(T) - 1));
+
+            if (streaming)
+            {
+                for ( ; target < last; target += 32 / sizeof(T)) vector.stream (target);
+
+                stream_fence ();
+            }
+            else
+            {
+                for ( ; target < last; target += 32 / sizeof(T)) vector.store (target);
+            }
+
+            while (target < end) *target++ = value;
+        }
+
+    }
+
+#endif
@@ -0,0 +1,197 @@
+/**
+ * @file Swap_Chain.hpp
+ * @author Gonzalo Perez Chamarro
+ * @brief Cadena de buffers de color que pasa los frames terminados a un hilo que los presenta o los codifica
+ * @version 0.1
+ * @date 2019-03-10
+ *
+ * @copyright Copyright (c) 2019
+ *
+ */
+
+#ifndef SWAP_CHAIN_HEADER
+#define SWAP_CHAIN_HEADER
+
+    #include <atomic>
+    #include <memory>
+    #include <thread>
+    #include <vector>
+
+    namespace example
+    {
+
+        /**
+         * @brief Los buffers circulan entre dos hilos por dos colas sin bloqueos de un solo productor y
+         * un solo consumidor: el hilo que pinta saca buffers libres y mete frames terminados, y el que
+         * presenta saca frames terminados y devuelve los buffers libres. Los frames se presentan todos
+         * y en orden. Si el hilo que presenta se retrasa, el que pinta espera a que quede un buffer
+         * libre y, si se adelanta, es el que presenta quien espera al siguiente frame.
+         *
+         */
+        template< class COLOR_BUFFER >
+        class Swap_Chain
+        {
+        public:
+
+            typedef COLOR_BUFFER Color_Buffer;
+
+        private:
+
+            /**
+             * @brief Cola circular de índices de buffers con un hueco más que buffers, de modo que nunca
+             * se llena. head solo lo escribe quien saca y tail quien mete.
+             *
+             */
+            class Index_Queue
+            {
+                std::vector< size_t > slots;
+                std::atomic< size_t > head;
+                std::atomic< size_t > tail;
+
+            public:
+
+                Index_Queue(size_t capacity)
+                :
+                    slots(capacity + 1),
+                    head (0),
+                    tail (0)
+                {
+                }
+
+                void push (size_t index)
+                {
+                    size_t position = tail.load (std::memory_order_relaxed);
+
+                    slots[position] = index;
+
+                    tail.store ((position + 1) % slots.size (), std::memory_order_release);
+                }
+
+                bool pop (size_t & index)
+                {
+                    size_t position = head.load (std::memory_order_relaxed);
+
+                    if (position == tail.load (std::memory_order_acquire)) return (false);
+
+                    index = slots[position];
+
+                    head.store ((position + 1) % slots.size (), std::memory_order_release);
+
+                    return (true);
+                }
+            };
+
+            std::vector< std::unique_ptr< Color_Buffer > > buffers;
+
+            Index_Queue         free_buffers;
+            Index_Queue         ready_buffers;
+            std::atomic< bool > closed;
+
+            size_t back;                        // Buffer que tiene el hilo que pinta (o buffers.size ())
+            size_t front;                       // Buffer que tiene el hilo que presenta (o buffers.size ())
+
+        public:
+
+            /**
+             * @brief Crea length buffers iguales a target (mismo tamaño y misma disposición)
+             *
+             */
+            Swap_Chain(const Color_Buffer & target, size_t length)
+            :
+                free_buffers (length),
+                ready_buffers(length),
+                closed       (false),
+                back         (length),
+                front        (length)
+            {
+                for (size_t index = 0; index < length; ++index)
+                {
+                    buffers.emplace_back (new Color_Buffer(target.get_width (), target.get_height (), target.is_tiled ()));
+
+                    free_buffers.push (index);
+                }
+            }
+
+            Swap_Chain(const Swap_Chain & ) = delete;
+            Swap_Chain & operator = (const Swap_Chain & ) = delete;
+
+        public:
+
+            size_t get_length () const
+            {
+                return (buffers.size ());
+            }
+
+/**
+ * @brief Hilo que pinta: espera a que haya un buffer libre y lo devuelve para que se rellene con el
+ * siguiente frame
+ *
+ * @return Color_Buffer&
+ */
+            Color_Buffer & acquire_back ()
+            {
+                while (!free_buffers.pop (back)) std::this_thread::yield ();
+
+                return (*buffers[back]);
+            }
+
+/**
+ * @brief Hilo que pinta: encola para presentarlo el buffer obtenido con acquire_back()
+ *
+ */
+            void present ()
+            {
+                ready_buffers.push (back);
+
+                back = buffers.size ();
+            }
+
+/**
+ * @brief Hilo que presenta: espera al siguiente frame terminado. Devuelve nullptr cuando, tras
+ * llamar a close(), ya no quedan frames por presentar.
+ *
+ * @return const Color_Buffer*
+ */
+            const Color_Buffer * acquire_front ()
+            {
+                while (!ready_buffers.pop (front))
+                {
+                    // Lo encolado antes de close() ya es visible tras leer closed:
+
+                    if (closed.load (std::memory_order_acquire))
+                    {
+                        if (!ready_buffers.pop (front)) return (nullptr);
+                        break;
+                    }
+
+                    std::this_thread::yield ();
+                }
+
+                return (buffers[front].get ());
+            }
+
+/**
+ * @brief Hilo que presenta: devuelve el buffer obtenido con acquire_front() una vez presentado
+ *
+ */
+            void release_front ()
+            {
+                free_buffers.push (front);
+
+                front = buffers.size ();
+            }
+
+/**
+ * @brief Avisa al hilo que presenta de que no habrá más frames
+ *
+ */
+            void close ()
+            {
+                closed.store (true, std::memory_order_release);
+            }
+
+        };
+
+    }
+
+#endif
@@ -0,0 +1,324 @@
+/**
+ * @file Video_Sink.hpp
+ * @author Gonzalo Perez Chamarro
+ * @brief Hilo que escribe los frames de una Swap_Chain como vídeo Y4M o RGBA sin comprimir en un FILE
+ * @version 0.1
+ * @date 2019-03-10
+ *
+ * @copyright Copyright (c) 2019
+ *
+ */
+
+#ifndef VIDEO_SINK_HEADER
+#define VIDEO_SINK_HEADER
+
+    #include "Color_Buffer_Rgb565.hpp"
+    #include "Color_Buffer_Rgba8888.hpp"
+    #include "Simd.hpp"
+    #include "Swap_Chain.hpp"
+    #include <algorithm>
+    #include <atomic>
+    #include <cstdio>
+    #include <cstring>
+    #include <thread>
+    #include <vector>
+
+    namespace example
+    {
+
+        /**
+         * @brief Copia un frame a target como píxeles RGBA de 32 bits (R en el byte más bajo), con la fila
+         * de arriba primero. Los buffers de color tienen la fila 0 abajo.
+         *
+         */
+        inline void read_rgba (const Color_Buffer_Rgba8888 & frame, uint32_t * target)
+        {
+            size_t width  = frame.get_width  ();
+            size_t height = frame.get_height ();
+
+            for (size_t y = height; y-- > 0; target += width)
+            {
+                // Sin tiles la fila entera es contigua y con tiles se copia cada fila de un tile:
+
+                for (size_t x = 0, count; x < width; x += count)
+                {
+                    count = frame.is_tiled () ? std::min (width - x, size_t(Color_Buffer::tile_size)) : width;
+
+                    std::memcpy (target + x, frame.colors () + frame.offset_at (x, y), count * sizeof(uint32_t));
+                }
+            }
+        }
+
+        inline void read_rgba (const Color_Buffer_Rgb565 & frame, uint32_t * target)
+        {
+            size_t width  = frame.get_width  ();
+            size_t height = frame.get_height ();
+
+            for (size_t y = height; y-- > 0; target += width)
+            {
+                for (size_t x = 0; x < width; ++x)
+                {
+                    uint32_t value = frame.colors ()[frame.offset_at (x, y)].value;
+                    uint32_t r     = value >> 11, g = value >> 5 & 63, b = value & 31;
+
+                    // Los bits altos se repiten en los bajos para que el máximo sea 255:
+
+                    target[x] = (r << 3 | r >> 2) | (g << 2 | g >> 4) << 8 | (b << 3 | b >> 2) << 16 | 0xFF000000u;
+                }
+            }
+        }
+
+        /**
+         * @brief Convierte una imagen RGBA a YUV 4:2:0 con los coeficientes enteros de BT.601 en rango
+         * limitado (Y en [16, 235]). Cada muestra de U y V sale de la media de un bloque de 2x2 píxeles,
+         * repitiendo la última columna y la última fila si el tamaño es impar. Se convierten 8 píxeles
+         * a la vez y el código escalar de los bordes da exactamente el mismo resultado.
+         *
+         */
+        class Yuv420_Converter
+        {
+            static int luma (uint32_t pixel)
+            {
+                int r = pixel & 0xFF, g = pixel >> 8 & 0xFF, b = pixel >> 16 & 0xFF;
+
+                return (((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+            }
+
+            // Se suman los 4 píxeles del bloque. El sesgo de 128 << 10 hace positivo el numerador, de modo
+            // que el desplazamiento redondea igual que en SIMD:
+
+            static void chroma (uint32_t p0, uint32_t p1, uint32_t p2, uint32_t p3, uint8_t & u, uint8_t & v)
+            {
+                int r = int(p0 & 0xFF) + int(p1 & 0xFF) + int(p2 & 0xFF) + int(p3 & 0xFF);
+                int g = int(p0 >> 8 & 0xFF) + int(p1 >> 8 & 0xFF) + int(p2 >> 8 & 0xFF) + int(p3 >> 8 & 0xFF);
+                int b = int(p0 >> 16 & 0xFF) + int(p1 >> 16 & 0xFF) + int(p2 >> 16 & 0xFF) + int(p3 >> 16 & 0xFF);
+
+                u = uint8_t((-38 * r -  74 * g + 112 * b + 512 + (128 << 10)) >> 10);
+                v = uint8_t((112 * r -  94 * g -  18 * b + 512 + (128 << 10)) >> 10);
+            }
+
+            static Int32x8 channel (const Int32x8 & pixels, int shift)
+            {
+                return (shift_right (pixels, shift) & Int32x8::broadcast (0xFF));
+            }
+
+        public:
+
+            static size_t chroma_width  (size_t width ) { return ((width  + 1) / 2); }
+            static size_t chroma_height (size_t height) { return ((height + 1) / 2); }
+
+            /**
+             * @brief Escribe los planos Y (width x height), U y V (chroma_width x chroma_height)
+             *
+             */
+            static void convert (const uint32_t * rgba, size_t width, size_t height, uint8_t * y_plane, uint8_t * u_plane, uint8_t * v_plane)
+            {
+                const Int32x8 y_r  = Int32x8::broadcast ( 66), y_g = Int32x8::broadcast (129), y_b = Int32x8::broadcast ( 25);
+                const Int32x8 u_r  = Int32x8::broadcast (-38), u_g = Int32x8::broadcast (-74), u_b = Int32x8::broadcast (112);
+                const Int32x8 v_r  = Int32x8::broadcast (112), v_g = Int32x8::broadcast (-94), v_b = Int32x8::broadcast (-18);
+                const Int32x8 y_bias      = Int32x8::broadcast (128 + (16 << 8));
+                const Int32x8 chroma_bias = Int32x8::broadcast (512 + (128 << 10));
+
+                // Cada pareja de filas se lee una vez para Y y otra para U y V, cuando ya está en la caché:
+
+                for (size_t y = 0; y < chroma_height (height); ++y)
+                {
+                    for (size_t luma_y = 2 * y; luma_y < std::min (2 * y + 2, height); ++luma_y)
+                    {
+                        const uint32_t * row    = rgba    + luma_y * width;
+                        uint8_t        * target = y_plane + luma_y * width;
+                        size_t           x      = 0;
+
+                        for ( ; x + 8 <= width; x += 8)
+                        {
+                            Int32x8 pixels = Int32x8::load (row + x);
+                            Int32x8 sum    = multiply_16 (channel (pixels, 0), y_r) + multiply_16 (channel (pixels, 8), y_g) + multiply_16 (channel (pixels, 16), y_b);
+
+                            shift_right (sum + y_bias, 8).store_bytes (target + x);
+                        }
+
+                        for ( ; x < width; ++x) target[x] = uint8_t(luma (row[x]));
+                    }
+
+                    const uint32_t * row0 = rgba + 2 * y * width;
+                    const uint32_t * row1 = rgba + std::min (2 * y + 1, height - 1) * width;
+                    uint8_t        * u    = u_plane + y * chroma_width (width);
+                    uint8_t        * v    = v_plane + y * chroma_width (width);
+                    size_t           x    = 0;
+
+                    // Se suman las dos filas, se multiplican por los coeficientes y se suman las columnas de
+                    // dos en dos, con lo que las lanes pares tienen los 4 bloques de los 8 píxeles:
+
+                    for ( ; x + 8 <= width; x += 8)
+                    {
+                        Int32x8 p0 = Int32x8::load (row0 + x);
+                        Int32x8 p1 = Int32x8::load (row1 + x);
+
+                        Int32x8 r  = channel (p0,  0) + channel (p1,  0);
+                        Int32x8 g  = channel (p0,  8) + channel (p1,  8);
+                        Int32x8 b  = channel (p0, 16) + channel (p1, 16);
+
+                        uint8_t u_lanes[8], v_lanes[8];
+
+                        shift_right (add_pairs (multiply_16 (r, u_r) + multiply_16 (g, u_g) + multiply_16 (b, u_b)) + chroma_bias, 10).store_bytes (u_lanes);
+                        shift_right (add_pairs (multiply_16 (r, v_r) + multiply_16 (g, v_g) + multiply_16 (b, v_b)) + chroma_bias, 10).store_bytes (v_lanes);
+
+                        for (int lane = 0; lane < 4; ++lane)
+                        {
+                            u[x / 2 + lane] = u_lanes[lane * 2];
+                            v[x / 2 + lane] = v_lanes[lane * 2];
+                        }
+                    }
+
+                    for ( ; x < width; x += 2)
+                    {
+                        size_t right = std::min (x + 1, width - 1);
+
+                        chroma (row0[x], row0[right], row1[x], row1[right], u[x / 2], v[x / 2]);
+                    }
+                }
+            }
+        };
+
+        /**
+         * @brief Saca los frames de una Swap_Chain en otro hilo y los escribe en output como un vídeo
+         * YUV4MPEG2 4:2:0 o como píxeles RGBA sin cabecera, de arriba abajo. La cola es la propia cadena:
+         * el hilo que pinta solo espera a la escritura cuando todos sus buffers están pendientes, y la
+         * conversión de color se hace en el hilo que escribe.
+         *
+         */
+        template< class COLOR_BUFFER >
+        class Video_Sink
+        {
+        public:
+
+            enum Format
+            {
+                RAW_RGBA,
+                Y4M
+            };
+
+        private:
+
+            Swap_Chain< COLOR_BUFFER > & source;
+            FILE                       * output;
+            Format                       format;
+            unsigned                     frame_rate;
+
+            std::vector< uint32_t >      rgba;
+            std::vector< uint8_t  >      yuv;
+            std::atomic< bool >          failed;
+
+            std::thread                  writer;
+
+        public:
+
+            /**
+             * @brief Empieza a sacar frames de source. output tiene que seguir abierto hasta finish().
+             *
+             */
+            Video_Sink(Swap_Chain< COLOR_BUFFER > & source, FILE * output, Format format, unsigned frame_rate = 60)
+            :
+                source    (source    ),
+                output    (output    ),
+                format    (format    ),
+                frame_rate(frame_rate),
+                failed    (false     )
+            {
+                writer = std::thread(&Video_Sink::write_frames, this);
+            }
+
+           ~Video_Sink()
+            {
+                finish ();
+            }
+
+            Video_Sink(const Video_Sink & ) = delete;
+            Video_Sink & operator = (const Video_Sink & ) = delete;
+
+        public:
+
+            /**
+             * @brief Si falló alguna escritura, por ejemplo porque se cerró el otro extremo del pipe. A
+             * partir de ahí los frames se descartan sin escribirlos.
+             *
+             */
+            bool has_failed () const
+            {
+                return (failed);
+            }
+
+            /**
+             * @brief Cierra la cadena, espera a que se escriban los frames encolados y devuelve si se
+             * escribieron todos
+             *
+             */
+            bool finish ()
+            {
+                if (writer.joinable ())
+                {
+                    source.close ();
+                    writer.join  ();
+                }
+
+                return (!failed);
+            }
+
+        private:
+
+            void write_frames ()
+            {
+                bool header = format == Y4M;
+
+                while (auto frame = source.acquire_front ())
+                {
+                    if (!failed)
+                    {
+                        size_t width  = frame->get_width  ();
+                        size_t height = frame->get_height ();
+
+                        if (header && std::fprintf (output, "YUV4MPEG2 W%zu H%zu F%u:1 Ip A1:1 C420jpeg\n", width, height, frame_rate) < 0) failed = true;
+
+                        header = false;
+
+                        rgba.resize (width * height);
+
+                        read_rgba (*frame, rgba.data ());
+
+                        // El buffer se devuelve en cuanto se ha copiado, antes de convertir y escribir:
+
+                        source.release_front ();
+
+                        if (!failed && !write_frame (width, height)) failed = true;
+                    }
+                    else
+                    {
+                        source.release_front ();
+                    }
+                }
+
+                if (std::fflush (output) != 0) failed = true;
+            }
+
+            bool write_frame (size_t width, size_t height)
+            {
+                if (format == RAW_RGBA)
+                {
+                    return (std::fwrite (rgba.data (), sizeof(uint32_t), rgba.size (), output) == rgba.size ());
+                }
+
+                size_t luma_size   = width * height;
+                size_t chroma_size = Yuv420_Converter::chroma_width (width) * Yuv420_Converter::chroma_height (height);
+
+                yuv.resize (luma_size + 2 * chroma_size);
+
+                Yuv420_Converter::convert (rgba.data (), width, height, yuv.data (), yuv.data () + luma_size, yuv.data () + luma_size + chroma_size);
+
+                return (std::fputs ("FRAME\n", output) >= 0 && std::fwrite (yuv.data (), 1, yuv.size (), output) == yuv.size ());
+            }
+
+        };
+
+    }
+
+#endif
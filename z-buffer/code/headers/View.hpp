@@ -18,10 +18,13 @@
 #include "Rasterizer.hpp"
 #include "Color_Buffer_Rgb565.hpp"
 #include "Color_Buffer_Rgba8888.hpp"
+#include "Swap_Chain.hpp"
+#include "Worker_Pool.hpp"
 
 #include "Model.hpp"
 
 #include <rapidxml.hpp>
+#include <chrono>
 #include <list>
 #include <iostream>
 #include <fstream>
@@ -37,9 +40,44 @@ namespace example
 
     class View
     {
-    private:
+    public:
 
         typedef Color_Buffer_Rgba8888 Color_Buffer;
+
+/**
+ * @brief Duracion en milisegundos de las etapas del ultimo frame
+ * 
+ */
+		struct Frame_Timings
+		{
+			double update_ms;    // Transformar e iluminar los modelos
+			double paint_ms;     // Rasterizar y presentar o encolar el frame
+			double frame_ms;     // Todo render_frame(): el intervalo entre dos frames
+			double latency_ms;   // Desde que empezo el update del frame pintado hasta que termino su paint
+
+			// Partes de update_ms y paint_ms. Con pipelining, las del update son del frame siguiente:
+
+			double transform_ms; // Transformar e iluminar los vertices
+			double culling_ms;   // Buffer de oclusion en el update y descarte por oclusion en el paint
+			double clear_ms;     // Limpiar el buffer de color y el z-buffer (con fast clear, solo marcarlos)
+			double raster_ms;    // Ordenar los modelos, rasterizarlos y resolver el frame
+		};
+
+/**
+ * @brief Duracion en milisegundos de la carga de la escena
+ * 
+ */
+		struct Load_Timings
+		{
+			double xml_ms;       // Leer y recorrer el xml, sin contar los modelos
+			double obj_ms;       // Cargar los obj y preparar los modelos
+		};
+
+    private:
+
+		typedef std::chrono::steady_clock Clock;
+		typedef std::chrono::duration< double, std::milli > Milliseconds;
+
         typedef Color_Buffer::Color   Color;
         typedef Point4f               Vertex;
         typedef vector< Vertex >      Vertex_Buffer;
@@ -70,6 +108,11 @@ namespace example
  * 
  */
         Rasterizer< Color_Buffer > rasterizer;
+/**
+ * @brief Z de baja resolucion de los oclusores
+ * 
+ */
+		Occlusion_Buffer occlusion_buffer;
 		Color color;
 
         Vertex_Buffer     original_vertices;
@@ -84,6 +127,83 @@ namespace example
  */
 		std::list<std::shared_ptr<Model>> models;
 
+/**
+ * @brief Modelos que no son hijos de ningun otro
+ * 
+ */
+		std::list<std::shared_ptr<Model>> root_models;
+
+/**
+ * @brief Modelos por su indice en los identificadores de primitiva
+ * 
+ */
+		vector<std::shared_ptr<Model>> indexed_models;
+
+/**
+ * @brief Si se pinta en el modo visibility buffer
+ * 
+ */
+		bool visibility_buffer;
+
+/**
+ * @brief Si se pinta con una pasada previa de profundidad
+ * 
+ */
+		bool depth_prepass;
+
+/**
+ * @brief Si se saltan los modelos que quedaron ocultos en el frame anterior
+ * 
+ */
+		bool occlusion_culling;
+
+/**
+ * @brief Si se descartan los modelos que quedan detras de los oclusores antes de transformarlos
+ * 
+ */
+		bool occluder_culling;
+
+/**
+ * @brief Si los modelos se pintan de delante a atras
+ * 
+ */
+		bool depth_sorting;
+
+/**
+ * @brief Orden en el que se pintan los modelos de indexed_models en el frame actual y buffer
+ * auxiliar de la ordenacion
+ * 
+ */
+		vector<Sort_Entry> model_order;
+		vector<Sort_Entry> sort_scratch;
+
+/**
+ * @brief Cadena de buffers a la que paint() pasa los frames terminados, o nullptr si paint() los
+ * presenta directamente
+ * 
+ */
+		std::unique_ptr<Swap_Chain<Color_Buffer>> swap_chain;
+
+/**
+ * @brief Hilo en el que render_frame() actualiza el frame siguiente mientras pinta el actual, o
+ * nullptr si los ejecuta uno detras de otro
+ * 
+ */
+		std::unique_ptr<Worker_Pool> pipeline;
+
+/**
+ * @brief Si el frame que pinta el siguiente render_frame() ya se ha actualizado y cuando empezo
+ * su update
+ * 
+ */
+		bool pipeline_primed;
+		Clock::time_point update_start;
+
+		Frame_Timings timings;
+		Frame_Timings update_timings;         // Lo que mide update_models(), que se junta en timings
+		Frame_Timings paint_timings;          // Lo que mide paint()
+		Load_Timings  load_timings;
+
 /**
  * @brief Lista de luces
  * 
@@ -96,6 +216,18 @@ namespace example
  */
 		const float AMBIENTAL_INTENSITY = 0.1f;
 
+/**
+ * @brief Carpeta del xml de la escena, en la que se buscan los obj
+ * 
+ */
+		string resource_path;
+
+/**
+ * @brief Si se cargaron la escena y todos sus modelos
+ * 
+ */
+		bool loaded;
+
 
     public:
 /**
@@ -104,8 +236,17 @@ namespace example
  * @param path Ruta del xml de la escena
  * @param width Ancho de la ventana
  * @param height Alto de la ventana
+ * @param tiled_layout Guarda el buffer de color y el z-buffer en tiles de 8x8 pixels en lugar de por filas
+ */
+        View(const std::string & path, size_t width, size_t height, bool tiled_layout = false);
+/**
+ * @brief Devuelve si se cargaron la escena y todos sus modelos. Si no, se pinta lo que se haya cargado.
+ * 
+ * @return true 
+ * @return false 
  */
-        View(const std::string & path, size_t width, size_t height);
+		bool is_loaded() const { return loaded; }
+
 /**
  * @brief Actualizacion de la escena
  * 
@@ -118,6 +259,182 @@ namespace example
  */
         void paint  ();
 
+/**
+ * @brief Actualiza y pinta un frame. Sin pipelining equivale a update() seguido de paint(). Con
+ * pipelining pinta el frame actualizado en la llamada anterior mientras otro hilo actualiza el
+ * siguiente, de modo que cada frame se ve una llamada despues de actualizarse.
+ * 
+ */
+		void render_frame();
+
+/**
+ * @brief Activa la ejecucion de render_frame() en dos etapas solapadas. Cada modelo guarda
+ * entonces dos frames, uno que se pinta y otro que se actualiza. Como el update que se solapa con
+ * un paint aun no sabe que modelos oculta ese paint, el descarte por oclusion usa el resultado del
+ * paint anterior: se siguen saltando las transformaciones de los modelos ocultos, pero uno que deja
+ * de estar tapado tarda un frame mas en volver a pintarse.
+ * 
+ * @param enabled 
+ */
+		void set_pipelining(bool enabled);
+
+		bool get_pipelining() const { return bool(pipeline); }
+
+/**
+ * @brief Devuelve los tiempos del ultimo render_frame()
+ * 
+ * @return const Frame_Timings& 
+ */
+		const Frame_Timings & get_frame_timings() const { return timings; }
+
+/**
+ * @brief Devuelve cuanto tardo en cargarse la escena
+ * 
+ * @return const Load_Timings& 
+ */
+		const Load_Timings & get_load_timings() const { return load_timings; }
+
+/**
+ * @brief Activa el modo visibility buffer: se rasterizan identificadores y el color se calcula
+ * una vez por pixel visible
+ * 
+ * @param enabled 
+ */
+		void set_visibility_buffer(bool enabled);
+
+		bool get_visibility_buffer() const { return visibility_buffer; }
+
+/**
+ * @brief Activa la pasada previa de profundidad: primero se escribe la Z de todos los modelos y
+ * despues se pintan con un test de igualdad, de modo que cada pixel se colorea una sola vez
+ * 
+ * @param enabled 
+ */
+		void set_depth_prepass(bool enabled) { depth_prepass = enabled; }
+
+		bool get_depth_prepass() const { return depth_prepass; }
+
+/**
+ * @brief Activa el descarte por oclusion: los modelos (y jerarquias de modelos) de los que no se
+ * vio ningun pixel en el frame anterior no se actualizan ni se pintan hasta que su caja envolvente
+ * vuelve a pasar el test de profundidad
+ * 
+ * @param enabled 
+ */
+		void set_occlusion_culling(bool enabled);
+
+		bool get_occlusion_culling() const { return occlusion_culling; }
+
+/**
+ * @brief Devuelve cuantos modelos se saltan en el siguiente frame por estar ocultos
+ * 
+ * @return size_t 
+ */
+		size_t get_occluded_models() const;
+
+/**
+ * @brief Activa el buffer de oclusion: en cada update se transforman primero los modelos marcados
+ * como oclusores (<occluder>true</occluder> en el xml), se pintan a baja resolucion y los demas
+ * modelos cuya caja envolvente queda detras no se transforman ni se pintan en ese frame
+ * 
+ * @param enabled 
+ */
+		void set_occluder_culling(bool enabled);
+
+		bool get_occluder_culling() const { return occluder_culling; }
+
+/**
+ * @brief Devuelve cuantos modelos descarto el buffer de oclusion en el ultimo update
+ * 
+ * @return size_t 
+ */
+		size_t get_culled_models() const;
+
+/**
+ * @brief Activa la ordenacion de los modelos de delante a atras segun la distancia a la camara del
+ * centro de su caja envolvente, de modo que los pixels de los modelos tapados fallan el test de
+ * profundidad en lugar de colorearse y sobrescribirse despues
+ * 
+ * @param enabled 
+ */
+		void set_depth_sorting(bool enabled) { depth_sorting = enabled; }
+
+		bool get_depth_sorting() const { return depth_sorting; }
+
+/**
+ * @brief Activa en todos los modelos la ordenacion de delante a atras de sus grupos de triangulos
+ * 
+ * @param enabled 
+ */
+		void set_cluster_sorting(bool enabled);
+
+		bool get_cluster_sorting() const;
+
+/**
+ * @brief Activa la cadena de buffers con buffer_count buffers en total, contando en el que se pinta
+ * (2 es doble buffer y 3 triple buffer). paint() deja entonces de llamar a OpenGL: encola el frame
+ * terminado en la cadena, de donde lo recoge otro hilo con acquire_front() y lo devuelve con
+ * release_front(), mientras se pinta el siguiente. Con 0 o 1, paint() presenta cada frame antes de
+ * retornar. No se puede cambiar mientras otro hilo usa la cadena.
+ * 
+ * @param buffer_count 
+ */
+		void set_swap_chain(size_t buffer_count);
+
+		Swap_Chain<Color_Buffer> * get_swap_chain() { return swap_chain.get(); }
+
+/**
+ * @brief Buffer en el que pinta paint(). Sin cadena de buffers, tras render_frame() contiene el frame
+ * que se acaba de pintar
+ * 
+ */
+		const Color_Buffer & get_color_buffer() const { return Color_buffer; }
+
+/**
+ * @brief Devuelve los pixels coloreados en el ultimo frame
+ * 
+ * @return size_t 
+ */
+		size_t get_color_writes() const { return rasterizer.get_color_writes(); }
+
+/**
+ * @brief Devuelve cuantos triangulos del ultimo frame se descartaron por ser degenerados o por
+ * no cubrir ningun pixel y cuantos se rellenaron como triangulos pequenos o por el camino general
+ * 
+ * @return Rasterizer< Color_Buffer >::Triangle_Statistics 
+ */
+		Rasterizer< Color_Buffer >::Triangle_Statistics get_triangle_statistics() const { return rasterizer.get_triangle_statistics(); }
+
+/**
+ * @brief Devuelve los contadores de trabajo y de trafico de memoria del ultimo frame. Solo se
+ * cuentan si se compila con RASTERIZER_STATISTICS.
+ * 
+ * @return Rasterizer< Color_Buffer >::Raster_Statistics 
+ */
+		Rasterizer< Color_Buffer >::Raster_Statistics get_raster_statistics() { return rasterizer.get_raster_statistics(); }
+
+/**
+ * @brief Guarda como imagen TGA el mapa de overdraw del ultimo frame: negro donde no se pinto
+ * nada y, de azul a rojo, las veces que se escribio el color de cada pixel (rojo a partir de 6).
+ * Solo funciona si se compila con RASTERIZER_STATISTICS.
+ * 
+ * @param path Ruta de la imagen
+ * @return true Imagen guardada
+ * @return false Sin estadisticas o error al escribir
+ */
+		bool save_overdraw(const std::string & path);
+
+/**
+ * @brief Devuelve el modelo visible en un pixel del ultimo frame (con la Y hacia abajo, como
+ * las coordenadas de la ventana), o nullptr si no hay ninguno. Solo funciona en el modo
+ * visibility buffer.
+ * 
+ * @param x 
+ * @param y 
+ * @return std::shared_ptr<Model> 
+ */
+		std::shared_ptr<Model> pick(int x, int y) const;
+
     private:
 /**
  * @brief Carga de la escena desde el xml
@@ -144,6 +461,28 @@ namespace example
 		bool parse_light(xml_Node * light_data);
 
         bool is_frontface (const Vertex * const projected_vertices, const int * const indices);
+/**
+ * @brief Prepara los modelos para el siguiente frame (ver Model::advance_frame)
+ * 
+ * @param double_buffered 
+ */
+		void advance_frame(bool double_buffered);
+/**
+ * @brief Transforma e ilumina los modelos. Es la etapa de update, que con pipelining se ejecuta
+ * en otro hilo y solo toca el frame de los modelos que no se pinta y el buffer de oclusion.
+ * 
+ */
+		void update_models();
+/**
+ * @brief Copia en timings las partes de update_timings y de paint_timings
+ * 
+ */
+		void add_stage_timings();
+/**
+ * @brief Calcula en model_order el orden en el que se pintan los modelos
+ * 
+ */
+		void sort_models();
 
     };
 
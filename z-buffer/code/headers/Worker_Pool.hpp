@@ -0,0 +1,203 @@
+/**
+ * @file Worker_Pool.hpp
+ * @author Gonzalo Perez Chamarro
+ * @brief Conjunto de hilos persistentes que reparten trabajos indexados
+ * @version 0.1
+ * @date 2019-03-10
+ *
+ * @copyright Copyright (c) 2019
+ *
+ */
+
+#ifndef WORKER_POOL_HEADER
+#define WORKER_POOL_HEADER
+
+    #include <atomic>
+    #include <condition_variable>
+    #include <functional>
+    #include <mutex>
+    #include <thread>
+    #include <vector>
+
+    namespace example
+    {
+
+        /**
+         * @brief Los hilos se crean una sola vez y esperan dormidos entre ejecuciones. El hilo que
+         * llama a run() también trabaja (es el trabajador 0), por lo que un pool de N trabajadores
+         * solo crea N - 1 hilos.
+         *
+         */
+        class Worker_Pool
+        {
+        public:
+
+            typedef std::function< void (size_t job, size_t worker) > Job;
+
+        private:
+
+            std::vector< std::thread > threads;
+
+            std::mutex                 mutex;
+            std::condition_variable    job_ready;
+            std::condition_variable    job_done;
+
+            const Job                * job;
+            Job                        launched_job;
+            size_t                     job_count;
+            std::atomic< size_t >      next_job;
+            size_t                     busy_workers;
+            unsigned                   generation;
+            bool                       exiting;
+
+        public:
+
+            Worker_Pool(size_t worker_count)
+            :
+                job         (nullptr),
+                job_count   (0),
+                next_job    (0),
+                busy_workers(0),
+                generation  (0),
+                exiting     (false)
+            {
+                for (size_t worker = 1; worker < worker_count; ++worker)
+                {
+                    threads.emplace_back (&Worker_Pool::work, this, worker);
+                }
+            }
+
+           ~Worker_Pool()
+            {
+                {
+                    std::lock_guard< std::mutex > lock(mutex);
+
+                    exiting = true;
+                }
+
+                job_ready.notify_all ();
+
+                for (auto & thread : threads) thread.join ();
+            }
+
+            Worker_Pool(const Worker_Pool & ) = delete;
+            Worker_Pool & operator = (const Worker_Pool & ) = delete;
+
+        public:
+
+            size_t get_worker_count () const
+            {
+                return (threads.size () + 1);
+            }
+
+            /**
+             * @brief Ejecuta job(i, trabajador) para cada i en [0, count) y no retorna hasta que
+             * todos los trabajos han terminado
+             *
+             * @param count Numero de trabajos
+             * @param new_job Funcion a ejecutar por cada trabajo
+             */
+            void run (size_t count, const Job & new_job)
+            {
+                if (count == 0) return;
+
+                {
+                    std::lock_guard< std::mutex > lock(mutex);
+
+                    job          = &new_job;
+                    job_count    = count;
+                    next_job     = 0;
+                    busy_workers = threads.size ();
+                    generation++;
+                }
+
+                job_ready.notify_all ();
+
+                drain (0);
+
+                wait ();
+            }
+
+            /**
+             * @brief Como run(), pero retorna enseguida y el hilo que llama no trabaja: los trabajos
+             * los hacen los demás hilos mientras el que llama hace otra cosa, hasta que llama a wait().
+             * new_job se copia. Si el pool no tiene más hilos que el que llama, equivale a run().
+             *
+             * @param count Numero de trabajos
+             * @param new_job Funcion a ejecutar por cada trabajo
+             */
+            void launch (size_t count, const Job & new_job)
+            {
+                if (threads.empty ()) { run (count, new_job); return; }
+
+                wait ();
+
+                if (count == 0) return;
+
+                launched_job = new_job;
+
+                {
+                    std::lock_guard< std::mutex > lock(mutex);
+
+                    job          = &launched_job;
+                    job_count    = count;
+                    next_job     = 0;
+                    busy_workers = threads.size ();
+                    generation++;
+                }
+
+                job_ready.notify_all ();
+            }
+
+            /**
+             * @brief Espera a que terminen los trabajos de la última llamada a run() o a launch()
+             *
+             */
+            void wait ()
+            {
+                std::unique_lock< std::mutex > lock(mutex);
+
+                job_done.wait (lock, [this] { return busy_workers == 0; });
+
+                job = nullptr;
+            }
+
+        private:
+
+            void work (size_t worker)
+            {
+                unsigned seen_generation = 0;
+
+                while (true)
+                {
+                    {
+                        std::unique_lock< std::mutex > lock(mutex);
+
+                        job_ready.wait (lock, [&] { return exiting || generation != seen_generation; });
+
+                        if (exiting) return;
+
+                        seen_generation = generation;
+                    }
+
+                    drain (worker);
+
+                    std::lock_guard< std::mutex > lock(mutex);
+
+                    if (--busy_workers == 0) job_done.notify_one ();
+                }
+            }
+
+            void drain (size_t worker)
+            {
+                for (size_t index; (index = next_job++) < job_count; )
+                {
+                    (*job)(index, worker);
+                }
+            }
+
+        };
+
+    }
+
+#endif
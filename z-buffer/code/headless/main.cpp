@@ -0,0 +1,271 @@
+/**
+ * @file main.cpp
+ * @author Gonzalo Perez Chamarro
+ * @brief Pinta una escena sin ventana ni OpenGL y guarda cada frame como imagen TGA o lo envía como vídeo
+ * a la salida estándar o a un pipe
+ * @version 0.1
+ * @date 2019-03-10
+ *
+ * @copyright Copyright (c) 2019
+ *
+ */
+
+#include "View.hpp"
+#include "Video_Sink.hpp"
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+    #include <fcntl.h>
+    #include <io.h>
+#endif
+
+extern "C"
+{
+    #include <targa.h>
+}
+
+using namespace example;
+
+namespace
+{
+
+    struct Options
+    {
+        std::string scene;
+        size_t      width;
+        size_t      height;
+        size_t      frames;
+        std::string output;
+        std::string video;                              // Ruta del vídeo, "-" para la salida estándar o vacía para TGA
+        Video_Sink< View::Color_Buffer >::Format format;
+        unsigned    frame_rate;
+        size_t      queue;                              // Frames que pueden esperar a escribirse
+    };
+
+    void print_usage (const char * program)
+    {
+        std::cerr << "uso: " << program << " [--scene escena.xml] [--size 800x600] [--frames 100] [--output carpeta]" << std::endl
+                  << "       [--y4m ruta | --rgba ruta] [--fps 60] [--queue 2]" << std::endl
+                  << "Con --y4m o --rgba los frames se escriben como vídeo en la ruta (un pipe, por ejemplo) o, con -," << std::endl
+                  << "en la salida estándar, en lugar de como imágenes TGA en la carpeta de --output." << std::endl;
+    }
+
+    /**
+     * @brief Lee las opciones de la línea de comandos sobre los valores por defecto de options
+     *
+     */
+    bool parse_options (int argc, char ** argv, Options & options)
+    {
+        for (int index = 1; index + 1 < argc; index += 2)
+        {
+            std::string option = argv[index];
+            const char * value = argv[index + 1];
+
+            if (option == "--scene" ) options.scene  = value; else
+            if (option == "--output") options.output = value; else
+            if (option == "--y4m"   ) options.video  = value, options.format = Video_Sink< View::Color_Buffer >::Y4M;      else
+            if (option == "--rgba"  ) options.video  = value, options.format = Video_Sink< View::Color_Buffer >::RAW_RGBA; else
+            if (option == "--frames")
+            {
+                if (std::sscanf (value, "%zu", &options.frames) != 1) return (false);
+            }
+            else
+            if (option == "--fps")
+            {
+                if (std::sscanf (value, "%u", &options.frame_rate) != 1 || options.frame_rate == 0) return (false);
+            }
+            else
+            if (option == "--queue")
+            {
+                if (std::sscanf (value, "%zu", &options.queue) != 1 || options.queue == 0) return (false);
+            }
+            else
+            if (option == "--size")
+            {
+                if (std::sscanf (value, "%zux%zu", &options.width, &options.height) != 2) return (false);
+            }
+            else
+                return (false);
+        }
+
+        // Las opciones van por parejas y el TGA guarda el tamaño en 16 bits:
+
+        return (argc % 2 == 1 && options.width > 0 && options.height > 0 && options.width <= 65535 && options.height <= 65535);
+    }
+
+    /**
+     * @brief Guarda un frame como TGA de 24 bits. El buffer tiene la fila 0 abajo y la imagen se
+     * guarda de arriba abajo.
+     *
+     */
+    template< class COLOR_BUFFER >
+    bool save_frame (const COLOR_BUFFER & frame, const std::string & path, std::vector< uint8_t > & image)
+    {
+        size_t width  = frame.get_width  ();
+        size_t height = frame.get_height ();
+
+        image.resize (width * height * 3);
+
+        uint8_t * target = image.data ();
+
+        for (size_t y = height; y-- > 0; )
+        {
+            for (size_t x = 0; x < width; ++x, target += 3)
+            {
+                auto & color = frame.colors ()[frame.offset_at (x, y)].data.component;
+
+                target[0] = color.b;
+                target[1] = color.g;
+                target[2] = color.r;
+            }
+        }
+
+        return (tga_write_bgr (path.c_str (), image.data (), uint16_t(width), uint16_t(height), 24) == TGA_NOERR);
+    }
+
+}
+
+int main (int argc, char ** argv)
+{
+    Options options = { "../resources/scene.xml", 800, 600, 100, ".", "", Video_Sink< View::Color_Buffer >::Y4M, 60, 2 };
+
+    if (!parse_options (argc, argv, options))
+    {
+        print_usage (argv[0]);
+
+        return (EXIT_FAILURE);
+    }
+
+    View view(options.scene, options.width, options.height);
+
+    if (!view.is_loaded ())
+    {
+        std::cerr << "no se pudo cargar " << options.scene << std::endl;
+
+        return (EXIT_FAILURE);
+    }
+
+    FILE * video = nullptr;
+
+    if (!options.video.empty ())
+    {
+        video = options.video == "-" ? stdout : std::fopen (options.video.c_str (), "wb");
+
+        if (!video)
+        {
+            std::cerr << "no se pudo abrir " << options.video << std::endl;
+
+            return (EXIT_FAILURE);
+        }
+
+        #ifdef _WIN32
+            if (video == stdout) _setmode (_fileno (stdout), _O_BINARY);
+        #endif
+
+        // Si el codificador cierra el pipe, la escritura falla en lugar de terminar el proceso:
+
+        #ifdef SIGPIPE
+            std::signal (SIGPIPE, SIG_IGN);
+        #endif
+    }
+
+    // Los frames terminados pasan por la cadena de buffers a un hilo que los guarda mientras se pinta
+    // el siguiente, y el update de cada frame se solapa con el paint del anterior. La cadena tiene un
+    // buffer por cada frame que puede esperar a escribirse, más el que se pinta:
+
+    view.set_swap_chain (options.queue + 1);
+    view.set_pipelining (true);
+
+    auto                swap_chain = view.get_swap_chain ();
+    std::atomic< bool > failed(false);
+
+    std::unique_ptr< Video_Sink< View::Color_Buffer > > sink;
+    std::thread                                         writer;
+
+    if (video)
+    {
+        sink.reset (new Video_Sink< View::Color_Buffer >(*swap_chain, video, options.format, options.frame_rate));
+    }
+    else
+    {
+        writer = std::thread
+        (
+            [&options, &failed, swap_chain] ()
+            {
+                std::vector< uint8_t > image;
+                char                   name[32];
+
+                for (size_t index = 0; auto frame = swap_chain->acquire_front (); ++index)
+                {
+                    std::snprintf (name, sizeof(name), "/frame_%05zu.tga", index);
+
+                    // Tras el primer error se siguen devolviendo los buffers, para que no se detenga el que pinta:
+
+                    if (!failed && !save_frame (*frame, options.output + name, image))
+                    {
+                        std::cerr << "no se pudo escribir " << options.output + name << std::endl;
+
+                        failed = true;
+                    }
+
+                    swap_chain->release_front ();
+                }
+            }
+        );
+    }
+
+    typedef std::chrono::steady_clock Clock;
+
+    View::Frame_Timings total    = View::Frame_Timings();
+    Clock::time_point   start    = Clock::now ();
+    size_t              rendered = 0;
+
+    for ( ; rendered < options.frames && !failed && !(sink && sink->has_failed ()); ++rendered)
+    {
+        view.render_frame ();
+
+        const View::Frame_Timings & timings = view.get_frame_timings ();
+
+        total.update_ms  += timings.update_ms;
+        total.paint_ms   += timings.paint_ms;
+        total.frame_ms   += timings.frame_ms;
+        total.latency_ms += timings.latency_ms;
+    }
+
+    swap_chain->close ();
+
+    if (writer.joinable ()) writer.join ();
+
+    if (sink && !sink->finish ())
+    {
+        std::cerr << "no se pudo escribir " << options.video << std::endl;
+
+        failed = true;
+    }
+
+    if (video && video != stdout) std::fclose (video);
+
+    double seconds = std::chrono::duration< double >(Clock::now () - start).count ();
+    double frames  = double(std::max< size_t >(rendered, 1));
+
+    // Con el vídeo en la salida estándar, el resumen va a la de errores:
+
+    std::fprintf
+    (
+        video == stdout ? stderr : stdout,
+        "%zu frames en %.2f s (%.1f fps): update %.2f ms, paint %.2f ms, frame %.2f ms, latencia %.2f ms\n",
+        rendered, seconds, rendered / seconds,
+        total.update_ms / frames, total.paint_ms / frames, total.frame_ms / frames, total.latency_ms / frames
+    );
+
+    return (failed ? EXIT_FAILURE : EXIT_SUCCESS);
+}
@@ -15,6 +15,7 @@
 #include <iostream>
 
 #include <math.h>
+#include <cmath>
 #include <vector>
 #include <tiny_obj_loader.h>
 
@@ -24,9 +25,20 @@ namespace example
 	using namespace tinyobj;
 	using std::max;
 
+	/**
+	 * @brief Indices de los poligonos recortados, cuyos vertices se guardan en orden
+	 * 
+	 */
+	static const int clipped_indices[] = { 0, 1, 2, 3, 4, 5, 6, 7, 8 };
+
 	Model::Model(const string & name, const std::string & path, Translation3f position, Scaling3f scale, float rx, float ry, float rz, Color c)
-		:position(position), scale(scale), name(name)
+		:update_frame(0), paint_frame(0), position(position), scale(scale), name(name), model_index(0), far_clipping(false), occluded(false), update_occluded(false), subtree_occluded(false), culled(false), occluder(false), cluster_sorting(true)
 	{
+		for (auto & corner : bounding_box)
+		{
+			corner = Point4f({ 0.f, 0.f, 0.f, 1.f });
+		}
+
 		//Recibe la rotacion inicial local
 		rotation[0] = rx;
 		rotation[1] = ry;
@@ -83,14 +95,71 @@ namespace example
 			copy_normals.push_back(original_normals[index.normal_index]);
 		}
 
+		//Se calcula la caja envolvente en coordenadas locales, con la que se prueba el modelo mientras esta oculto
+		if (!copy_vertices.empty())
+		{
+			Vertex box_min = copy_vertices.front();
+			Vertex box_max = box_min;
+
+			for (auto const & vertex : copy_vertices)
+			{
+				for (int i = 0; i < 3; ++i)
+				{
+					box_min[i] = std::min(box_min[i], vertex[i]);
+					box_max[i] = std::max(box_max[i], vertex[i]);
+				}
+			}
+
+			for (int corner = 0; corner < 8; ++corner)
+			{
+				bounding_box[corner] = Point4f({
+					corner & 1 ? box_max[0] : box_min[0],
+					corner & 2 ? box_max[1] : box_min[1],
+					corner & 4 ? box_max[2] : box_min[2],
+					1.f });
+			}
+		}
+
+		//Se calcula el centro de cada grupo de triangulos consecutivos, con el que se ordenan al pintar
+		for (size_t first = 0; first < copy_vertices.size(); first += cluster_triangles * 3)
+		{
+			size_t last = std::min(first + cluster_triangles * 3, copy_vertices.size());
+
+			Vertex cluster_min = copy_vertices[first];
+			Vertex cluster_max = cluster_min;
+
+			for (size_t index = first; index < last; ++index)
+			{
+				for (int i = 0; i < 3; ++i)
+				{
+					cluster_min[i] = std::min(cluster_min[i], copy_vertices[index][i]);
+					cluster_max[i] = std::max(cluster_max[i], copy_vertices[index][i]);
+				}
+			}
+
+			cluster_centers.push_back(Point4f({
+				(cluster_min[0] + cluster_max[0]) * 0.5f,
+				(cluster_min[1] + cluster_max[1]) * 0.5f,
+				(cluster_min[2] + cluster_max[2]) * 0.5f,
+				1.f }));
+		}
+
 		//Reescala el resto de buffers a utilizar posteriormente
 		original_colors.resize(copy_vertices.size());
-		transformed_vertices.resize(copy_vertices.size());
-		display_vertices.resize(original_colors.size());
-		transformed_colors.resize(original_colors.size());
-		transformed_normals.resize(copy_normals.size());
+		screen_vertices.resize(copy_vertices.size());
 		number_of_vertices = copy_vertices.size();
 
+		for (Frame & frame : frames)
+		{
+			frame.transformed_vertices.resize(copy_vertices.size());
+			frame.clip_space_vertices.resize(copy_vertices.size());
+			frame.transformed_colors.resize(original_colors.size());
+			frame.transformed_normals.resize(copy_normals.size());
+			frame.ambiental_intensity = 0.f;
+			frame.deferred_lighting = false;
+			frame.skipped = true;
+		}
+
 		//Se crea el buffer de indices del orden de los vértices.
 		//Al colocar los vertices y normales en su orden, este buffer es una simple enumeracion
 		//*Ha sido necesario su utilización para  no modificar demasiado código del rasterizador*
@@ -107,7 +176,7 @@ namespace example
 		}
 	}
 
-	void Model::update(Projection3f * projection, std::shared_ptr<Light> light, float ambiental_intensity)
+	void Model::update_transform(Projection3f * projection)
 	{
 		//Se ejerce la rotacion en Y
 		rotation[1] += rotation_speed;
@@ -117,38 +186,32 @@ namespace example
 
 		//Se realizan las transformaciones adecuadas
 		normals_tr = position * rotation_x * rotation_y * rotation_z * scale *  global_tr;
-		transform = (*projection) * normals_tr;
+		frames[update_frame].transform = (*projection) * normals_tr;
 		
 		//Se actualizan los hijos
 		refresh_children_transform();
+	}
 
-		for(size_t index = 0; index < number_of_vertices; ++index)
-		{
-			//LIGHTNING
-			Vertex & vertex = transformed_vertices[index] = Matrix44f(transform) * Matrix41f(copy_vertices[index]);
-			Vertex & normal_vertex = transformed_normals[index] = Matrix44f(normals_tr) * Matrix41f(copy_normals[index]);
-
-			//Sobrecargado el operador de indexacion en Translation3f
-			Vector3f light_position = Vector3f({ light->get_position()[0], light->get_position()[2], light->get_position()[2] });
-			Vector3f norm_light_pos = normalize_vector(light_position);
-
-			Vector3f normal = Vector3f({ normal_vertex[0],normal_vertex[1] ,normal_vertex[2] });
-			Vector3f norm_normal = normalize_vector(normal);
+	void Model::update_vertices(std::shared_ptr<Light> light, float ambiental_intensity, bool deferred_lighting)
+	{
+		Frame & frame = frames[update_frame];
 
-			//Se realiza el producto escalar entre las normales y el vector de la luz
-			// Y se maximiza para que no de un valor negativo.
-			//Se comprueba el mínimo, para que la suma de luz ambiental no supere 1
-			float light_intensity = std::max(dot(norm_normal, norm_light_pos), 0.f) + ambiental_intensity;
-			light_intensity = std::min(light_intensity, 1.0f);
+		frame.light = light;
+		frame.ambiental_intensity = ambiental_intensity;
+		frame.deferred_lighting = deferred_lighting;
 
+		//De los modelos ocultos solo se necesita el transform, para probar su caja envolvente
+		frame.skipped = update_occluded || culled;
 
-			transformed_colors[index] = original_colors[index];
-			transformed_colors[index].data.component.r *= light_intensity;
-			transformed_colors[index].data.component.g *= light_intensity;
-			transformed_colors[index].data.component.b *= light_intensity;
+		if (frame.skipped) return;
 
-			//End Lightning
+		for(size_t index = 0; index < number_of_vertices; ++index)
+		{
+			Vertex & vertex = frame.transformed_vertices[index] = Matrix44f(frame.transform) * Matrix41f(copy_vertices[index]);
+			Vertex & normal_vertex = frame.transformed_normals[index] = Matrix44f(normals_tr) * Matrix41f(copy_normals[index]);
 
+			//Se conserva el vertice antes de dividir por w para recortarlo con los planos cercano y lejano
+			frame.clip_space_vertices[index] = vertex;
 
 			float divisor = 1.f / vertex[3];
 
@@ -164,29 +227,483 @@ namespace example
 			normal_vertex[2] *= divisor;
 			normal_vertex[3] = 1.f;
 		}
+
+		//En el modo visibility buffer solo se iluminan los triangulos visibles, al resolver el color
+		if (!deferred_lighting)
+		{
+			for (size_t index = 0; index < number_of_vertices; ++index)
+			{
+				frame.transformed_colors[index] = light_vertex(frame, index);
+			}
+		}
 	}
 
-	void Model::paint(Rasterizer<Color_Buffer> * rasterizer)
+	Model::Color Model::light_vertex(const Frame & frame, size_t index) const
 	{
-		Scaling3f scaling = Scaling3f(float(rasterizer->get_color_buffer().get_width() / 2), float(rasterizer->get_color_buffer().get_height() / 2), 100000000.f);
-		Translation3f translation = Translation3f(float(rasterizer->get_color_buffer().get_width() / 2), float(rasterizer->get_color_buffer().get_height() / 2), 0.f);
-		Transformation3f transformation = translation * scaling;
+		const std::shared_ptr<Light> & light = frame.light;
+
+		//Sobrecargado el operador de indexacion en Translation3f
+		Vector3f light_position = Vector3f({ light->get_position()[0], light->get_position()[2], light->get_position()[2] });
+		Vector3f norm_light_pos = normalize_vector(light_position);
+
+		const Vertex & normal_vertex = frame.transformed_normals[index];
+
+		Vector3f normal = Vector3f({ normal_vertex[0],normal_vertex[1] ,normal_vertex[2] });
+		Vector3f norm_normal = normalize_vector(normal);
+
+		//Se realiza el producto escalar entre las normales y el vector de la luz
+		// Y se maximiza para que no de un valor negativo.
+		//Se comprueba el mínimo, para que la suma de luz ambiental no supere 1
+		float light_intensity = std::max(dot(norm_normal, norm_light_pos), 0.f) + frame.ambiental_intensity;
+		light_intensity = std::min(light_intensity, 1.0f);
+
+		Color color = original_colors[index];
+		color.data.component.r *= light_intensity;
+		color.data.component.g *= light_intensity;
+		color.data.component.b *= light_intensity;
+
+		return color;
+	}
+
+	Transformation3f Model::get_viewport_transform(size_t width, size_t height)
+	{
+		//La Z en [-1, 1] se lleva al rango [0, depth_max] que esperan los formatos del z_buffer
+		Scaling3f scaling = Scaling3f(float(width / 2), float(height / 2), float(depth_max / 2));
+		Translation3f translation = Translation3f(float(width / 2), float(height / 2), float(depth_max / 2));
+
+		return translation * scaling;
+	}
+
+	void Model::paint(Rasterizer<Color_Buffer> * rasterizer, bool depth_only)
+	{
+		if (!is_painted()) return;
+
+		const Frame & frame = frames[paint_frame];
+		const Vertex_Buffer & transformed_vertices = frame.transformed_vertices;
+		const Vertex_Buffer & clip_space_vertices = frame.clip_space_vertices;
+
+		Transformation3f transformation = get_viewport_transform(rasterizer->get_color_buffer().get_width(), rasterizer->get_color_buffer().get_height());
+
+		//Se cuentan los pixels visibles del modelo. En la pasada previa de profundidad no se cuentan,
+		// porque los de la pasada de igualdad son exactamente los que quedan visibles
+		if (!depth_only) rasterizer->begin_query(int(model_index));
 
 		for (size_t index = 0, n_Vertices = transformed_vertices.size(); index < n_Vertices; index++) {
-			display_vertices[index] = Point4i(Matrix44f(transformation) * Matrix41f(transformed_vertices[index]));
+			screen_vertices[index] = Matrix44f(transformation) * Matrix41f(transformed_vertices[index]);
 		}
-	
 
-		for (int * indices = index_order.data(), *end = indices + index_order.size(); indices < end; indices +=3)
+		clipped_vertices.clear();
+		batch_vertices.clear();
+		batch_indices.clear();
+		batch_colors.clear();
+		batch_ids.clear();
+
+		//Los grupos de triangulos se pintan de delante a atras, para que los pixels que el propio modelo tapa
+		// fallen el test de profundidad en lugar de escribir un color que luego se sobrescribe
+		sort_clusters();
+
+		for (const Sort_Entry & cluster : cluster_order)
 		{
-			if (is_frontface(transformed_vertices.data(), indices))
+			int * first = index_order.data() + size_t(cluster.index) * cluster_triangles * 3;
+			int * last = std::min(first + cluster_triangles * 3, index_order.data() + index_order.size());
+
+			for (int * indices = first; indices < last; indices += 3)
 			{
-				//En esta parte se debería añadir el recorte(Se podría realizar antes)
-				//De esta manera solo se recortarían las caras que miran a camara
-				rasterizer->set_color(transformed_colors[*indices]);
-				rasterizer->fill_convex_polygon_z_buffer(display_vertices.data(),indices, indices+3);
+				size_t triangle = size_t(indices - index_order.data()) / 3;
+
+				//Se cuentan los vertices que quedan delante del plano cercano (z < -w) y detras del lejano (z > w)
+				int outside_near = 0;
+				int outside_far = 0;
+
+				for (int i = 0; i < 3; ++i)
+				{
+					const Vertex & vertex = clip_space_vertices[indices[i]];
+
+					if (vertex[2] + vertex[3] < 0.f) outside_near++;
+					if (far_clipping && vertex[3] - vertex[2] < 0.f) outside_far++;
+				}
+
+				if (outside_near == 3 || outside_far == 3) continue;
+
+				if (outside_near == 0 && outside_far == 0)
+				{
+					if (is_frontface(transformed_vertices.data(), indices))
+					{
+						batch_polygon(rasterizer, screen_vertices.data(), indices, indices + 3, triangle, depth_only);
+					}
+					continue;
+				}
+
+				//Los triangulos que cruzan los planos se recortan antes de dividir por w, que en los
+				// vertices de detras de la camara es negativa o nula
+				Point4f near_clipped[max_clipped_vertices];
+				Point4f far_clipped[max_clipped_vertices];
+				Point4f * polygon = near_clipped;
+
+				int count = clip_with_plane_3d(clip_space_vertices.data(), indices, indices + 3, near_clipped, 0.f, 0.f, 1.f, 1.f);
+
+				if (far_clipping)
+				{
+					count = clip_with_plane_3d(near_clipped, clipped_indices, clipped_indices + count, far_clipped, 0.f, 0.f, -1.f, 1.f);
+					polygon = far_clipped;
+				}
+
+				if (count < 3) continue;
+
+				size_t first_vertex = clipped_vertices.size();
+				float area = 0.f;
+
+				for (int i = 0; i < count; ++i)
+				{
+					Vertex vertex = polygon[i];
+
+					float divisor = 1.f / vertex[3];
+
+					vertex[0] *= divisor;
+					vertex[1] *= divisor;
+					vertex[2] *= divisor;
+					vertex[3] = 1.f;
+
+					clipped_vertices.push_back(Matrix44f(transformation) * Matrix41f(vertex));
+				}
+
+				//El poligono recortado mira a camara si su area en pantalla es positiva
+				const Vertex * screen_polygon = clipped_vertices.data() + first_vertex;
+
+				for (int i = 0, j = count - 1; i < count; j = i++)
+				{
+					area += screen_polygon[j][0] * screen_polygon[i][1] - screen_polygon[i][0] * screen_polygon[j][1];
+				}
+
+				if (area > 0.f)
+				{
+					batch_polygon(rasterizer, screen_polygon, clipped_indices, clipped_indices + count, triangle, depth_only);
+				}
 			}
 		}
+
+		//Todos los triangulos del modelo se rasterizan con una sola llamada
+		size_t triangle_count = batch_indices.size() / 3;
+
+		if (depth_only)
+		{
+			rasterizer->fill_triangles_depth(batch_vertices.data(), batch_indices.data(), triangle_count);
+		}
+		else
+		{
+			rasterizer->fill_triangles_z_buffer(batch_vertices.data(), batch_indices.data(), triangle_count, batch_colors.data(), batch_ids.data());
+		}
+
+		rasterizer->end_query();
+	}
+
+	void Model::sort_clusters()
+	{
+		cluster_order.resize(cluster_centers.size());
+
+		for (size_t cluster = 0; cluster < cluster_order.size(); ++cluster)
+		{
+			cluster_order[cluster].key = cluster_sorting ? quantize_depth(get_clip_w(cluster_centers[cluster])) : 0;
+			cluster_order[cluster].index = uint32_t(cluster);
+		}
+
+		if (cluster_sorting) radix_sort(cluster_order, sort_scratch);
+	}
+
+	bool Model::resolve_occlusion(Rasterizer<Color_Buffer> * rasterizer)
+	{
+		size_t width = rasterizer->get_color_buffer().get_width();
+		size_t height = rasterizer->get_color_buffer().get_height();
+
+		//Si en el frame anterior no se vio el modelo ni ninguno de sus descendientes, se prueba una
+		// sola caja que los envuelve a todos y, si queda oculta, no se consulta ninguno de ellos
+		if (subtree_occluded)
+		{
+			if (!is_box_visible(*rasterizer, width, height, true, paint_frame)) return false;
+
+			subtree_occluded = false;
+		}
+
+		//Los modelos pintados se consultan y los ocultos prueban su caja, de modo que vuelven a
+		// pintarse en el frame siguiente a aquel en el que dejan de estar tapados
+		//(los descartados por los oclusores tampoco se han pintado)
+		bool visible = !is_painted() ? is_box_visible(*rasterizer, width, height, false, paint_frame) : rasterizer->get_query_result(int(model_index)) > 0;
+		bool children_visible = false;
+
+		occluded = !visible;
+
+		for (auto & child : children)
+		{
+			if (child.second->resolve_occlusion(rasterizer)) children_visible = true;
+		}
+
+		subtree_occluded = !visible && !children_visible;
+
+		return visible || children_visible;
+	}
+
+	void Model::render_occluder(Occlusion_Buffer & buffer)
+	{
+		const Frame & frame = frames[update_frame];
+
+		if (frame.skipped) return;
+
+		const Vertex_Buffer & transformed_vertices = frame.transformed_vertices;
+		const Vertex_Buffer & clip_space_vertices = frame.clip_space_vertices;
+
+		Transformation3f transformation = get_viewport_transform(buffer.get_width(), buffer.get_height());
+
+		for (const int * indices = index_order.data(), *end = indices + index_order.size(); indices < end; indices += 3)
+		{
+			//Se saltan los triangulos que cruzan el plano cercano en lugar de recortarlos: dejar de pintar
+			// parte de un oclusor nunca oculta nada de mas
+			bool crosses_near = false;
+
+			for (int i = 0; i < 3; ++i)
+			{
+				const Vertex & vertex = clip_space_vertices[indices[i]];
+
+				if (vertex[2] + vertex[3] < 0.f) crosses_near = true;
+			}
+
+			if (crosses_near || !is_frontface(transformed_vertices.data(), indices)) continue;
+
+			buffer.render_triangle
+			(
+				Matrix44f(transformation) * Matrix41f(transformed_vertices[indices[0]]),
+				Matrix44f(transformation) * Matrix41f(transformed_vertices[indices[1]]),
+				Matrix44f(transformation) * Matrix41f(transformed_vertices[indices[2]])
+			);
+		}
+	}
+
+	bool Model::add_to_screen_box(const Transformation3f & viewport, Screen_Box & box, bool include_children, size_t frame) const
+	{
+		for (auto const & corner : bounding_box)
+		{
+			Vertex vertex = Matrix44f(frames[frame].transform) * Matrix41f(corner);
+
+			if (vertex[3] <= 0.f || vertex[2] + vertex[3] < 0.f) return false;
+
+			float divisor = 1.f / vertex[3];
+
+			vertex[0] *= divisor;
+			vertex[1] *= divisor;
+			vertex[2] *= divisor;
+			vertex[3] = 1.f;
+
+			vertex = Matrix44f(viewport) * Matrix41f(vertex);
+
+			box.x_min = std::min(box.x_min, vertex[0]);
+			box.y_min = std::min(box.y_min, vertex[1]);
+			box.x_max = std::max(box.x_max, vertex[0]);
+			box.y_max = std::max(box.y_max, vertex[1]);
+			box.z_min = std::min(box.z_min, vertex[2]);
+		}
+
+		if (include_children)
+		{
+			for (auto & child : children)
+			{
+				if (!child.second->add_to_screen_box(viewport, box, true, frame)) return false;
+			}
+		}
+
+		return true;
+	}
+
+	void Model::batch_polygon(Rasterizer<Color_Buffer> * rasterizer, const Vertex * vertices, const int * first_index, const int * last_index, size_t triangle, bool depth_only)
+	{
+		float width = float(rasterizer->get_color_buffer().get_width());
+		float height = float(rasterizer->get_color_buffer().get_height());
+
+		//Banda de guarda: coordenadas que el rasterizador maneja sin recortar (recorta cada scanline a la pantalla)
+		float guard_band = float(Rasterizer<Color_Buffer>::guard_band_limit);
+
+		//Se descartan los poligonos que quedan por completo a un lado de la pantalla y se comprueba
+		// si alguno de sus vertices sale de la banda de guarda
+		bool left = true, right = true, bottom = true, top = true;
+		bool inside_guard_band = true;
+
+		for (const int * index = first_index; index < last_index; ++index)
+		{
+			const Vertex & vertex = vertices[*index];
+
+			left = left && vertex[0] < 0.f;
+			right = right && vertex[0] >= width;
+			bottom = bottom && vertex[1] < 0.f;
+			top = top && vertex[1] >= height;
+			inside_guard_band = inside_guard_band && is_inside_guard_band(vertex, guard_band);
+		}
+
+		if (left || right || bottom || top) return;
+
+		int first_vertex = int(batch_vertices.size());
+		int count = int(last_index - first_index);
+
+		if (inside_guard_band)
+		{
+			for (int index = 0; index < count; ++index)
+			{
+				batch_vertices.push_back(snap_vertex(vertices[first_index[index]]));
+			}
+		}
+		else
+		{
+			//Solo se recortan los poligonos que salen de la banda de guarda. Sus vertices pueden no caber en un int
+			Point4f clipped_vertices[max_clipped_vertices];
+
+			count = clip_with_viewport_2d(vertices, first_index, last_index, clipped_vertices, -guard_band, -guard_band, guard_band, guard_band);
+
+			if (count < 3) return;
+
+			for (int index = 0; index < count; ++index)
+			{
+				batch_vertices.push_back(snap_vertex(clipped_vertices[index]));
+			}
+		}
+
+		//Los poligonos de mas de tres vertices se dividen en un abanico de triangulos con el mismo color
+		for (int index = 1; index + 1 < count; ++index)
+		{
+			batch_indices.push_back(first_vertex);
+			batch_indices.push_back(first_vertex + index);
+			batch_indices.push_back(first_vertex + index + 1);
+
+			if (depth_only) continue;
+
+			if (rasterizer->get_visibility_mode())
+			{
+				batch_ids.push_back(Rasterizer<Color_Buffer>::pack_primitive_id(model_index, uint32_t(triangle)));
+			}
+			else
+			{
+				const Frame & frame = frames[paint_frame];
+
+				//Un frame actualizado para el modo visibility buffer no tiene los colores de los vertices
+				batch_colors.push_back(frame.deferred_lighting ? light_vertex(frame, triangle * 3) : frame.transformed_colors[triangle * 3]);
+			}
+		}
+	}
+
+	int Model::clip_with_plane_3d
+	(
+		const Point4f * vertices,
+		const int      * first_index,
+		const int      * last_index,
+		Point4f * clipped_vertices,
+		float      a,
+		float      b,
+		float      c,
+		float      d
+	)
+	{
+		if (first_index == last_index) return 0;
+
+		//Igual que clip_with_line_2d, pero interpolando las cuatro coordenadas homogeneas
+		int count = 0;
+		const int * previous_index = last_index - 1;
+		const Point4f & last = vertices[*previous_index];
+		float previous_distance = a * last[0] + b * last[1] + c * last[2] + d * last[3];
+
+		for (const int * index = first_index; index < last_index; previous_index = index++)
+		{
+			const Point4f & previous = vertices[*previous_index];
+			const Point4f & current = vertices[*index];
+
+			float distance = a * current[0] + b * current[1] + c * current[2] + d * current[3];
+
+			if ((previous_distance >= 0.f) != (distance >= 0.f))
+			{
+				float t = previous_distance / (previous_distance - distance);
+
+				clipped_vertices[count++] = Point4f({
+					previous[0] + (current[0] - previous[0]) * t,
+					previous[1] + (current[1] - previous[1]) * t,
+					previous[2] + (current[2] - previous[2]) * t,
+					previous[3] + (current[3] - previous[3]) * t });
+			}
+
+			if (distance >= 0.f)
+			{
+				clipped_vertices[count++] = current;
+			}
+
+			previous_distance = distance;
+		}
+
+		return count;
+	}
+
+	int Model::clip_with_viewport_2d
+	(
+		const Point4f * vertices,
+		const int      * first_index,
+		const int      * last_index,
+		Point4f * clipped_vertices,
+		float      x_min,
+		float      y_min,
+		float      x_max,
+		float      y_max
+	)
+	{
+		//Se recorta con cada lado alternando entre dos buffers, de modo que el resultado final queda en clipped_vertices
+		Point4f aux_vertices[max_clipped_vertices];
+
+		int count = clip_with_line_2d(vertices, first_index, last_index, aux_vertices, 1.f, 0.f, -x_min);
+		count = clip_with_line_2d(aux_vertices, clipped_indices, clipped_indices + count, clipped_vertices, -1.f, 0.f, x_max);
+		count = clip_with_line_2d(clipped_vertices, clipped_indices, clipped_indices + count, aux_vertices, 0.f, 1.f, -y_min);
+		count = clip_with_line_2d(aux_vertices, clipped_indices, clipped_indices + count, clipped_vertices, 0.f, -1.f, y_max);
+
+		return count;
+	}
+
+	int Model::clip_with_line_2d
+	(
+		const Point4f * vertices,
+		const int      * first_index,
+		const int      * last_index,
+		Point4f * clipped_vertices,
+		float      a,
+		float      b,
+		float      c
+	)
+	{
+		if (first_index == last_index) return 0;
+
+		//Sutherland-Hodgman: se recorre cada lado (previous, current) y se conservan los vertices
+		// del lado interior y los puntos en los que los lados cruzan la recta
+		int count = 0;
+		const int * previous_index = last_index - 1;
+		float previous_distance = a * vertices[*previous_index][0] + b * vertices[*previous_index][1] + c;
+
+		for (const int * index = first_index; index < last_index; previous_index = index++)
+		{
+			const Point4f & previous = vertices[*previous_index];
+			const Point4f & current = vertices[*index];
+
+			float distance = a * current[0] + b * current[1] + c;
+
+			if ((previous_distance >= 0.f) != (distance >= 0.f))
+			{
+				float t = previous_distance / (previous_distance - distance);
+
+				clipped_vertices[count++] = Point4f({
+					previous[0] + (current[0] - previous[0]) * t,
+					previous[1] + (current[1] - previous[1]) * t,
+					previous[2] + (current[2] - previous[2]) * t,
+					1.f });
+			}
+
+			if (distance >= 0.f)
+			{
+				clipped_vertices[count++] = current;
+			}
+
+			previous_distance = distance;
+		}
+
+		return count;
 	}
 
 	void Model::refresh_children_transform()
@@ -19,6 +19,12 @@
 #include <Translation.hpp>
 
 #include <iostream>
+#include <thread>
+
+extern "C"
+{
+	#include <targa.h>
+}
 
 using namespace rapidxml;
 using namespace toolkit;
@@ -27,42 +33,427 @@ namespace example
 {
 
 
-    View::View(const std::string & path, size_t width, size_t height)
+    View::View(const std::string & path, size_t width, size_t height, bool tiled_layout)
     :
         width       (width ),
         height      (height),
-        Color_buffer(width, height),
-        rasterizer  (Color_buffer )
+        Color_buffer(width, height, tiled_layout),
+        rasterizer  (Color_buffer ),
+		occlusion_buffer(width, height),
+		visibility_buffer(false),
+		depth_prepass(false),
+		occlusion_culling(true),
+		occluder_culling(true),
+		depth_sorting(true),
+		pipeline_primed(false),
+		timings(),
+		update_timings(),
+		paint_timings(),
+		load_timings()
     {
        // Carga de escena desde xml
-		load_scene(path);
+		Clock::time_point load_start = Clock::now();
+
+		loaded = load_scene(path);
+
+		// parse_mesh() acumula en obj_ms lo que tardan en crearse los modelos
+		load_timings.xml_ms = Milliseconds(Clock::now() - load_start).count() - load_timings.obj_ms;
+
+		for (auto & m : models)
+		{
+			if (!m->get_error_message().empty()) loaded = false;
+		}
+
+		// Cada modelo se identifica en el visibility buffer por su posicion en indexed_models
+		for (auto & m : models)
+		{
+			m->set_model_index(uint32_t(indexed_models.size()));
+			indexed_models.push_back(m);
+		}
+
+		// Se rasteriza con un hilo por núcleo
+		rasterizer.set_worker_count(std::thread::hardware_concurrency());
+
+		// El buffer se limpia por bloques a medida que se pinta, en lugar de recorrerlo entero en cada frame
+		rasterizer.set_fast_clear(true);
 
     }
 
     void View::update ()
     {
+		advance_frame(false);
+		update_models();
+    }
+
+	void View::render_frame()
+	{
+		Clock::time_point frame_start = Clock::now();
+
+		if (!pipeline)
+		{
+			update();
+
+			Clock::time_point paint_start = Clock::now();
+
+			paint();
+
+			Clock::time_point paint_end = Clock::now();
+
+			timings.update_ms = Milliseconds(paint_start - frame_start).count();
+			timings.paint_ms = Milliseconds(paint_end - paint_start).count();
+			timings.frame_ms = timings.latency_ms = Milliseconds(paint_end - frame_start).count();
+			add_stage_timings();
+			return;
+		}
+
+		// El primer frame se actualiza antes de empezar a pintar
+		if (!pipeline_primed)
+		{
+			update_start = frame_start;
+			update();
+			pipeline_primed = true;
+		}
+
+		// Se pinta el frame que se acaba de actualizar y el siguiente se actualiza en el otro
+		advance_frame(true);
+
+		Clock::time_point painted_update_start = update_start;
+		Clock::time_point update_end;
+
+		pipeline->launch
+		(
+			1,
+			[this, &update_end](size_t, size_t)
+			{
+				update_start = Clock::now();
+				update_models();
+				update_end = Clock::now();
+			}
+		);
+
+		Clock::time_point paint_start = Clock::now();
+
+		paint();
+
+		Clock::time_point paint_end = Clock::now();
+
+		pipeline->wait();
+
+		timings.update_ms = Milliseconds(update_end - update_start).count();
+		timings.paint_ms = Milliseconds(paint_end - paint_start).count();
+		timings.frame_ms = Milliseconds(Clock::now() - frame_start).count();
+		timings.latency_ms = Milliseconds(paint_end - painted_update_start).count();
+		add_stage_timings();
+	}
+
+	void View::add_stage_timings()
+	{
+		timings.transform_ms = update_timings.transform_ms;
+		timings.culling_ms = update_timings.culling_ms + paint_timings.culling_ms;
+		timings.clear_ms = paint_timings.clear_ms;
+		timings.raster_ms = paint_timings.raster_ms;
+	}
+
+	void View::set_pipelining(bool enabled)
+	{
+		if (enabled == bool(pipeline)) return;
+
+		// Un hilo mas, que ejecuta las etapas de update
+		pipeline.reset(enabled ? new Worker_Pool(2) : nullptr);
+		pipeline_primed = false;
+	}
+
+	void View::advance_frame(bool double_buffered)
+	{
+		for (auto & m : models)
+		{
+			m->advance_frame(double_buffered);
+		}
+	}
+
+	void View::update_models()
+	{
 		Projection3f projection(0.3f, 1000.f, 90.f, (float)(width /height));
+
+		Clock::time_point start = Clock::now();
+
+		// Primero los transforms de todos los modelos (cada padre va antes que sus hijos)
+		for (auto & m : models)
+		{
+			m->update_transform(&projection);
+		}
+
+		Clock::time_point culling_start = Clock::now();
+		Clock::time_point culling_end = culling_start;
+
+		if (occluder_culling)
+		{
+			// Se transforman solo los oclusores, se pintan en el buffer de oclusion y con el se
+			// descartan los demas modelos antes de transformar sus vertices
+			for (auto & m : models)
+			{
+				if (m->is_occluder()) m->update_vertices(lights.front(), AMBIENTAL_INTENSITY, visibility_buffer);
+			}
+
+			culling_start = Clock::now();
+
+			occlusion_buffer.clear();
+
+			for (auto & m : models)
+			{
+				if (m->is_occluder()) m->render_occluder(occlusion_buffer);
+			}
+
+			for (auto & m : models)
+			{
+				m->set_culled(!m->is_occluder() && m->is_hidden_by(occlusion_buffer));
+			}
+
+			culling_end = Clock::now();
+		}
+
 		for (auto & m : models)
 		{
-			m->update(&projection, lights.front(),AMBIENTAL_INTENSITY);
+			if (occluder_culling && m->is_occluder()) continue;
+
+			m->update_vertices(lights.front(), AMBIENTAL_INTENSITY, visibility_buffer);
 		}
+
+		update_timings.culling_ms = Milliseconds(culling_end - culling_start).count();
+		update_timings.transform_ms = Milliseconds(Clock::now() - start).count() - update_timings.culling_ms;
     }
 
     void View::paint ()
     {
+		Clock::time_point start = Clock::now();
 
 		rasterizer.clear(0,100,255);
 
-		for (auto & m : models)
+		Clock::time_point clear_end = Clock::now();
+
+		sort_models();
+
+		if (depth_prepass)
+		{
+			// Primera pasada: solo la Z de todos los modelos
+			for (auto & entry : model_order)
+			{
+				indexed_models[entry.index]->paint(&rasterizer, true);
+			}
+
+			// Segunda pasada: cada pixel lo colorea el poligono cuya Z coincide con la guardada
+			rasterizer.set_depth_test(Rasterizer< Color_Buffer >::DEPTH_TEST_EQUAL);
+		}
+
+		for (auto & entry : model_order)
+		{
+			indexed_models[entry.index]->paint(&rasterizer);
+		}
+
+		rasterizer.set_depth_test(Rasterizer< Color_Buffer >::DEPTH_TEST_LESS);
+
+		Clock::time_point culling_start = Clock::now();
+
+		if (occlusion_culling)
+		{
+			// Con la Z de todo lo pintado se decide que modelos se saltan en el siguiente frame
+			for (auto & m : root_models)
+			{
+				m->resolve_occlusion(&rasterizer);
+			}
+		}
+
+		Clock::time_point culling_end = Clock::now();
+
+		if (visibility_buffer)
 		{
-			m->paint(&rasterizer);
+			// Se ilumina cada triangulo visible a partir de su identificador
+			rasterizer.resolve_visibility
+			(
+				[this](uint32_t id)
+				{
+					typedef Rasterizer< Color_Buffer > Raster;
+					return indexed_models[Raster::primitive_model(id)]->shade_triangle(Raster::primitive_triangle(id));
+				}
+			);
+		}
+		else
+		{
+			rasterizer.flush();
 		}
 
+		// La espera a un buffer libre y la presentacion quedan fuera de raster_ms
+		paint_timings.clear_ms = Milliseconds(clear_end - start).count();
+		paint_timings.culling_ms = Milliseconds(culling_end - culling_start).count();
+		paint_timings.raster_ms = Milliseconds(Clock::now() - clear_end).count() - paint_timings.culling_ms;
+
+		if (swap_chain)
+		{
+			// El frame pasa a un buffer libre de la cadena sin copiarlo y el siguiente se pinta sobre
+			// los pixels que tenia ese buffer
+			Color_buffer.swap_pixels(swap_chain->acquire_back());
+			swap_chain->present();
+			return;
+		}
+
+	#if !Z_BUFFER_HEADLESS
 		rasterizer.get_color_buffer().gl_draw_pixels(0, 0);
 		
 		glClearColor(0, 0, 1, 1);
+	#endif
     }
 
+	void View::set_swap_chain(size_t buffer_count)
+	{
+		// Uno de los buffer_count buffers es siempre en el que se pinta
+		if (buffer_count < 2)
+		{
+			swap_chain.reset();
+		}
+		else
+		{
+			swap_chain.reset(new Swap_Chain<Color_Buffer>(Color_buffer, buffer_count - 1));
+		}
+	}
+
+	void View::set_visibility_buffer(bool enabled)
+	{
+		visibility_buffer = enabled;
+		rasterizer.set_visibility_mode(enabled);
+	}
+
+	void View::sort_models()
+	{
+		model_order.resize(indexed_models.size());
+
+		// Los modelos ocultos o descartados no se pintan, asi que da igual donde queden
+		for (size_t index = 0; index < indexed_models.size(); ++index)
+		{
+			const Model & model = *indexed_models[index];
+
+			bool sorted = depth_sorting && model.is_painted();
+
+			model_order[index].key = sorted ? quantize_depth(model.get_view_depth()) : 0;
+			model_order[index].index = uint32_t(index);
+		}
+
+		if (depth_sorting) radix_sort(model_order, sort_scratch);
+	}
+
+	void View::set_cluster_sorting(bool enabled)
+	{
+		for (auto & m : models)
+		{
+			m->set_cluster_sorting(enabled);
+		}
+	}
+
+	bool View::get_cluster_sorting() const
+	{
+		return models.empty() || models.front()->get_cluster_sorting();
+	}
+
+	void View::set_occlusion_culling(bool enabled)
+	{
+		occlusion_culling = enabled;
+
+		if (!enabled)
+		{
+			for (auto & m : models)
+			{
+				m->reset_occlusion();
+			}
+		}
+	}
+
+	void View::set_occluder_culling(bool enabled)
+	{
+		occluder_culling = enabled;
+
+		if (!enabled)
+		{
+			for (auto & m : models)
+			{
+				m->set_culled(false);
+			}
+		}
+	}
+
+	size_t View::get_culled_models() const
+	{
+		size_t count = 0;
+
+		for (auto & m : models)
+		{
+			if (m->is_culled()) count++;
+		}
+
+		return count;
+	}
+
+	size_t View::get_occluded_models() const
+	{
+		size_t count = 0;
+
+		for (auto & m : models)
+		{
+			if (m->is_occluded()) count++;
+		}
+
+		return count;
+	}
+
+	std::shared_ptr<Model> View::pick(int x, int y) const
+	{
+		// El buffer de color se pinta con la fila 0 abajo
+		uint32_t id = rasterizer.get_primitive_id(x, int(height) - 1 - y);
+
+		if (id == Rasterizer< Color_Buffer >::no_primitive) return nullptr;
+
+		return indexed_models[Rasterizer< Color_Buffer >::primitive_model(id)];
+	}
+
+	bool View::save_overdraw(const std::string & path)
+	{
+		const std::vector< uint16_t > & overdraw = rasterizer.get_overdraw();
+
+		if (overdraw.empty()) return false;
+
+		// Colores BGR de 0, 1, 2... escrituras por pixel:
+		static const uint8_t palette[][3] =
+		{
+			{   0,   0,   0 },
+			{ 160,  32,   0 },
+			{ 192, 160,   0 },
+			{  32, 192,   0 },
+			{   0, 224, 224 },
+			{   0, 128, 255 },
+			{   0,   0, 255 }
+		};
+
+		const size_t palette_size = sizeof(palette) / sizeof(palette[0]);
+
+		vector< uint8_t > image(width * height * 3);
+
+		// La imagen se guarda de arriba abajo y el buffer de color tiene la fila 0 abajo
+		for (size_t y = 0; y < height; ++y)
+		{
+			uint8_t * target = image.data() + y * width * 3;
+
+			for (size_t x = 0; x < width; ++x, target += 3)
+			{
+				uint16_t        count = overdraw[Color_buffer.offset_at(x, height - 1 - y)];
+				const uint8_t * color = palette[std::min< size_t >(count, palette_size - 1)];
+
+				target[0] = color[0];
+				target[1] = color[1];
+				target[2] = color[2];
+			}
+		}
+
+		return tga_write_bgr(path.c_str(), image.data(), uint16_t(width), uint16_t(height), 24) == TGA_NOERR;
+	}
+
     bool View::is_frontface (const Vertex * const projected_vertices, const int * const indices)
     {
         const Vertex & v0 = projected_vertices[indices[0]];
@@ -77,8 +468,13 @@ namespace example
 
 	bool View::load_scene(const string & path)
 	{
+		//Los obj se buscan junto al xml
+		resource_path = path.substr(0, path.find_last_of("/\\") + 1);
+
 		ifstream xml_file(path);
 
+		if (!xml_file) return false;
+
 		xml_document<> document;
 		vector<char> buffer((std::istreambuf_iterator<char>(xml_file)), std::istreambuf_iterator<char>());
 		buffer.push_back('\0');
@@ -93,7 +489,11 @@ namespace example
 				//"Parseo" de un modelo
 				if (elem->type() == node_element && std::string(elem->name()) == "mesh") 
 				{
-					if (!parse_mesh(elem)) return false;
+					std::shared_ptr<Model> model = parse_mesh(elem);
+
+					if (!model) return false;
+
+					root_models.push_back(model);
 				}
 				//"Parseo" de una luz
 				else if (elem->type() == node_element && std::string(elem->name()) == "light") 
@@ -112,12 +512,13 @@ namespace example
 	std::shared_ptr<Model> View::parse_mesh(xml_Node * mesh_data)
 	{
 		//Ruta relativa a los .obj
-		string path = "..\\resources\\";
+		string path = resource_path;
 
 		Translation3f position;
 		float rot_x, rot_y, rot_z;
 		Scaling3f scale;
 		float rot_speed;
+		bool occluder = false;
 
 		string attributes;
 		string name;
@@ -189,6 +590,11 @@ namespace example
 				{
 					rot_speed = std::stof(tag->value());
 				}
+				//Si el modelo tapa a otros y se pinta en el buffer de oclusion
+				else if (string(tag->name()) == "occluder")
+				{
+					occluder = attributes == "true";
+				}
 				//Modelos hijos
 				else if (string(tag->name()) == "children")
 				{
@@ -205,15 +611,20 @@ namespace example
 
 		//El modelo padre es el ultimo en crearse, por lo que se realiza un push_front
 		// (y no push_back) para que en el momento de actualizarse, tenga preferencia el padre
+		Clock::time_point obj_start = Clock::now();
+
 		std::shared_ptr<Model> new_model(new Model(name, path, position, scale, rot_x, rot_y, rot_z, color));
 		models.push_front(new_model);
 
+		load_timings.obj_ms += Milliseconds(Clock::now() - obj_start).count();
+
 		for (std::map<string,std::shared_ptr<Model>>::iterator it = children.begin(); it != children.end(); ++it)
 		{
 			new_model->add_child(it->first, it->second);
 		}
 
 		new_model->set_rotation_speed_y(rot_speed);
+		new_model->set_occluder(occluder);
 
 		return new_model;
 	}
@@ -12,6 +12,7 @@
 #include "View.hpp"
 #include <SFML/Window.hpp>
 #include <SFML/OpenGL.hpp>
+#include <thread>
 
 using namespace sf;
 using namespace example;
@@ -42,6 +43,43 @@ int main ()
     glLoadIdentity ();
     glOrtho        (0, GLdouble(window_width), 0, GLdouble(window_height), -1, 1);
 
+    // The frames are handed to a presenter thread through a triple-buffered swap chain, so the next frame
+    // is rasterized while the previous one is drawn and the window waits for the vertical sync. The OpenGL
+    // context moves to that thread:
+
+    view.set_swap_chain (3);
+
+    // The models of the next frame are transformed and lit on another thread while the current frame is
+    // rasterized:
+
+    view.set_pipelining (true);
+
+    auto swap_chain = view.get_swap_chain ();
+
+    window.setActive (false);
+
+    std::thread presenter
+    (
+        [&window, swap_chain] ()
+        {
+            window.setActive (true);
+
+            while (auto frame = swap_chain->acquire_front ())
+            {
+                // glDrawPixels() has copied the pixels when it returns, so the buffer can be reused
+                // while the window waits to display it:
+
+                frame->gl_draw_pixels (0, 0);
+
+                swap_chain->release_front ();
+
+                window.display ();
+            }
+
+            window.setActive (false);
+        }
+    );
+
     // Run the main loop:
 
     bool running = true;
@@ -58,23 +96,134 @@ int main ()
             {
                 running = false;
             }
-        }
+            else
+            if (event.type == Event::KeyPressed && event.key.code == Keyboard::V)
+            {
+                // Toggle the visibility buffer mode:
 
-        // Update the view:
+                view.set_visibility_buffer (!view.get_visibility_buffer ());
+            }
+            else
+            if (event.type == Event::KeyPressed && event.key.code == Keyboard::P)
+            {
+                // Toggle the depth pre-pass and report the color writes of the last frame:
 
-        view.update ();
+                std::cout << "color writes: " << view.get_color_writes () << (view.get_depth_prepass () ? " (pre-pass)" : "") << std::endl;
 
-        // Repaint the view:
+                view.set_depth_prepass (!view.get_depth_prepass ());
+            }
+            else
+            if (event.type == Event::KeyPressed && event.key.code == Keyboard::T)
+            {
+                // Report how the triangles of the last frame were classified:
+
+                auto statistics = view.get_triangle_statistics ();
 
-        view.paint ();
+                std::cout << "triangles: "
+                          << statistics.degenerate << " degenerate, "
+                          << statistics.empty      << " empty, "
+                          << statistics.small      << " small, "
+                          << statistics.regular    << " regular" << std::endl;
+            }
+            else
+            if (event.type == Event::KeyPressed && event.key.code == Keyboard::O)
+            {
+                // Toggle the occlusion culling and report the models it skipped:
 
-        // Swap the OpenGL buffers:
+                std::cout << "occluded models: " << view.get_occluded_models () << (view.get_occlusion_culling () ? "" : " (culling off)") << std::endl;
 
-        window.display ();
+                view.set_occlusion_culling (!view.get_occlusion_culling ());
+            }
+            else
+            if (event.type == Event::KeyPressed && event.key.code == Keyboard::B)
+            {
+                // Toggle the occluder buffer and report the models it culled:
+
+                std::cout << "culled models: " << view.get_culled_models () << (view.get_occluder_culling () ? "" : " (occluder buffer off)") << std::endl;
+
+                view.set_occluder_culling (!view.get_occluder_culling ());
+            }
+            else
+            if (event.type == Event::KeyPressed && event.key.code == Keyboard::F)
+            {
+                // Toggle the front-to-back ordering of the models:
+
+                view.set_depth_sorting (!view.get_depth_sorting ());
+
+                std::cout << "model sorting " << (view.get_depth_sorting () ? "on" : "off") << std::endl;
+            }
+            else
+            if (event.type == Event::KeyPressed && event.key.code == Keyboard::C)
+            {
+                // Toggle the front-to-back ordering of the triangle clusters within each model:
+
+                view.set_cluster_sorting (!view.get_cluster_sorting ());
+
+                std::cout << "cluster sorting " << (view.get_cluster_sorting () ? "on" : "off") << std::endl;
+            }
+            else
+            if (event.type == Event::KeyPressed && event.key.code == Keyboard::H)
+            {
+                // Report the raster counters of the last frame and save its overdraw heatmap:
+
+                auto statistics = view.get_raster_statistics ();
+
+                if (!view.save_overdraw ("overdraw.tga"))
+                {
+                    std::cout << "raster statistics need RASTERIZER_STATISTICS=1" << std::endl;
+                }
+                else
+                {
+                    std::cout << "raster: "
+                              << statistics.polygons_submitted  << " polygons, "
+                              << statistics.spans               << " spans, "
+                              << statistics.pixels_tested       << " pixels tested, "
+                              << statistics.pixels_passed       << " passed, "
+                              << statistics.color_writes        << " color writes" << std::endl
+                              << "bytes: "
+                              << statistics.depth_bytes_read    << " depth read, "
+                              << statistics.depth_bytes_written << " depth written, "
+                              << statistics.color_bytes_written << " color written, "
+                              << statistics.depth_bytes_cleared + statistics.color_bytes_cleared << " cleared"
+                              << " (heatmap saved to overdraw.tga)" << std::endl;
+                }
+            }
+            else
+            if (event.type == Event::KeyPressed && event.key.code == Keyboard::L)
+            {
+                // Report the stage timings of the last frame and toggle the update/paint pipeline:
+
+                auto timings = view.get_frame_timings ();
+
+                std::cout << "update: "  << timings.update_ms  << " ms, "
+                          << "paint: "   << timings.paint_ms   << " ms, "
+                          << "frame: "   << timings.frame_ms   << " ms, "
+                          << "latency: " << timings.latency_ms << " ms"
+                          << (view.get_pipelining () ? " (pipelined)" : "") << std::endl;
+
+                view.set_pipelining (!view.get_pipelining ());
+            }
+            else
+            if (event.type == Event::MouseButtonPressed && view.get_visibility_buffer ())
+            {
+                // Pick the model under the cursor:
+
+                auto model = view.pick (event.mouseButton.x, event.mouseButton.y);
+
+                if (model) std::cout << model->get_name () << std::endl;
+            }
+        }
+
+        // Paint the last updated frame, queue it for the presenter and update the next one:
+
+        view.render_frame ();
     }
     while (running);
 
-    // Close the application:
+    // Let the presenter display the queued frames and close the application:
+
+    swap_chain->close ();
+    presenter .join  ();
 
     return (EXIT_SUCCESS);
 }
@@ -0,0 +1,152 @@
+/**
+ * @file depth_precision.cpp
+ * @author Gonzalo Perez Chamarro
+ * @brief Comprueba con los dos motores la precisión de cada formato de z_buffer cerca del plano lejano
+ * @version 0.1
+ * @date 2019-03-10
+ *
+ * @copyright Copyright (c) 2019
+ *
+ */
+
+#include "Color_Buffer_Rgba8888.hpp"
+#include "Rasterizer.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+using namespace example;
+
+namespace
+{
+
+    const size_t width  = 250;
+    const size_t height = 190;
+
+    /**
+     * @brief Z de la esquina superior izquierda y su incremento por pixel en X e Y. Los incrementos no
+     * son potencias de 2, de modo que la Z de los pixels recorre de manera uniforme los escalones de
+     * todos los formatos. La Z más lejana queda por debajo de depth_max y por encima de depth_max / 2,
+     * donde Depth_Float32 tiene su menor precisión.
+     *
+     */
+    const int z_origin  = depth_max - (1 << 22);
+    const int z_x_step  = 12345;
+    const int z_y_step  = -777;
+
+    /**
+     * @brief Dibuja un cuadrilátero que cubre toda la pantalla, inclinado en Z, y encima otro igual más
+     * cerca en separation. Devuelve la fracción de pixels en los que gana el cercano.
+     *
+     */
+    template< Raster_Engine ENGINE, class DEPTH_FORMAT >
+    double win_rate (int separation)
+    {
+        typedef Rasterizer< Color_Buffer_Rgba8888, ENGINE, DEPTH_FORMAT > Target_Rasterizer;
+
+        Color_Buffer_Rgba8888 color_buffer(width, height);
+        Target_Rasterizer     rasterizer  (color_buffer);
+
+        rasterizer.set_worker_count (1);
+        rasterizer.clear (0, 0, 0);
+
+        static const int corners[4][2] = { { 0, 0 }, { int(width), 0 }, { int(width), int(height) }, { 0, int(height) } };
+        static const int quad   [4]    = { 0, 1, 2, 3 };
+
+        for (int layer = 0; layer < 2; ++layer)
+        {
+            Point4i vertices[4];
+
+            for (int corner = 0; corner < 4; ++corner)
+            {
+                int x = corners[corner][0];
+                int y = corners[corner][1];
+
+                vertices[corner][0] = x * Target_Rasterizer::subpixel_size;
+                vertices[corner][1] = y * Target_Rasterizer::subpixel_size;
+                vertices[corner][2] = z_origin + x * z_x_step + y * z_y_step - layer * separation;
+                vertices[corner][3] = 1;
+            }
+
+            rasterizer.set_color (layer == 0 ? 255 : 0, layer == 0 ? 0 : 255, 0);
+            rasterizer.fill_convex_polygon_z_buffer (vertices, quad, quad + 4);
+        }
+
+        rasterizer.flush ();
+
+        Color_Buffer_Rgba8888::Color near_color;
+
+        near_color.set (0, 255, 0);
+
+        const Color_Buffer_Rgba8888::Color * colors = color_buffer.colors ();
+
+        size_t wins = 0;
+
+        for (size_t pixel = 0; pixel < width * height; ++pixel)
+        {
+            if (colors[pixel].data.value == near_color.data.value) wins++;
+        }
+
+        return (double(wins) / double(width * height));
+    }
+
+    /**
+     * @brief Compara con la esperada la fracción de pixels en los que gana el cuadrilátero cercano. Si
+     * un formato distingue Z separadas step cerca del plano lejano, dos Z separadas separation caen en
+     * escalones distintos en una fracción separation / step de los pixels.
+     *
+     */
+    template< Raster_Engine ENGINE, class DEPTH_FORMAT >
+    bool check (const char * engine, const char * format, int step)
+    {
+        static const int    separations[] = { 16, 256, 4096, 65536 };
+        static const double tolerance     = 0.01;
+
+        bool passed = true;
+
+        for (int separation : separations)
+        {
+            double expected = std::min (1.0, double(separation) / step);
+            double measured = win_rate< ENGINE, DEPTH_FORMAT > (separation);
+            bool   correct  = std::fabs (measured - expected) <= tolerance;
+
+            std::printf
+            (
+                "%-10s %-8s separacion %6d gana el cercano %6.2f%% (se esperaba %6.2f%%) %s\n",
+                engine, format, separation, measured * 100, expected * 100, correct ? "ok" : "FALLO"
+            );
+
+            passed &= correct;
+        }
+
+        return (passed);
+    }
+
+    template< class DEPTH_FORMAT >
+    bool check_engines (const char * format, int step)
+    {
+        bool passed = true;
+
+        passed &= check< SCANLINE_ENGINE  , DEPTH_FORMAT > ("scanline"  , format, step);
+        passed &= check< HALF_SPACE_ENGINE, DEPTH_FORMAT > ("half-space", format, step);
+
+        return (passed);
+    }
+
+}
+
+int main ()
+{
+    // Escalón de cada formato cerca del plano lejano, en unidades de la Z entera: Depth_Float32 tiene
+    // 24 bits de mantisa en [0.5, 1), los mismos que Depth_Unorm24.
+
+    bool passed = true;
+
+    passed &= check_engines< Depth_Int32   > ("int32"  , 1      );
+    passed &= check_engines< Depth_Unorm16 > ("unorm16", 1 << 14);
+    passed &= check_engines< Depth_Unorm24 > ("unorm24", 1 <<  6);
+    passed &= check_engines< Depth_Float32 > ("float32", 1 <<  6);
+
+    return (passed ? EXIT_SUCCESS : EXIT_FAILURE);
+}
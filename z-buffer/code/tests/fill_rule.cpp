@@ -0,0 +1,170 @@
+/**
+ * @file fill_rule.cpp
+ * @author Gonzalo Perez Chamarro
+ * @brief Comprueba que una malla cerrada colorea cada pixel exactamente una vez con los dos motores
+ * y con uno y varios hilos
+ * @version 0.1
+ * @date 2019-03-10
+ *
+ * @copyright Copyright (c) 2019
+ *
+ */
+
+#include "Color_Buffer_Rgba8888.hpp"
+#include "Rasterizer.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+using namespace example;
+
+namespace
+{
+
+    const size_t width  = 250;                          // Ni el ancho ni el alto son múltiplos del bloque
+    const size_t height = 190;
+
+    /**
+     * @brief Rejilla de celdas de cell pixels que cubre toda la pantalla y algo más, con cada vértice
+     * desplazado al azar hasta un 20% de la celda (lo justo para que los cuadriláteros sigan siendo
+     * convexos). Las celdas se envían como dos triángulos o como un cuadrilátero.
+     *
+     * Cada polígono tiene sus propios vértices y está más cerca que todos los anteriores, de modo que
+     * un pixel que cubriesen dos polígonos se escribiría dos veces y el mapa de overdraw lo delataría.
+     *
+     */
+    template< Raster_Engine ENGINE >
+    bool check (const char * engine, size_t workers, bool tiled, int cell, bool quads)
+    {
+        typedef Rasterizer< Color_Buffer_Rgba8888, ENGINE > Target_Rasterizer;
+
+        Color_Buffer_Rgba8888 color_buffer(width, height, tiled);
+        Target_Rasterizer     rasterizer  (color_buffer);
+
+        rasterizer.set_worker_count (workers);
+        rasterizer.clear ();
+
+        int columns = int(width ) / cell + 3;
+        int rows    = int(height) / cell + 3;
+        int size    = cell * Target_Rasterizer::subpixel_size;
+        int z       = depth_max - 1;
+
+        std::mt19937                         random(uint32_t(cell * 31 + quads));
+        std::uniform_int_distribution< int > jitter(-size / 5, size / 5);
+        std::vector< Point4i >               grid  (size_t(columns * rows));
+
+        for (int row = 0; row < rows; ++row)
+        {
+            for (int column = 0; column < columns; ++column)
+            {
+                Point4i & vertex = grid[row * columns + column];
+
+                vertex[0] = (column - 1) * size + jitter (random);
+                vertex[1] = (row    - 1) * size + jitter (random);
+                vertex[2] = 0;
+                vertex[3] = 1;
+            }
+        }
+
+        Color_Buffer_Rgba8888::Color color;
+
+        color.set (255, 255, 255);
+        rasterizer.set_color (color);
+
+        for (int row = 0; row + 1 < rows; ++row)
+        {
+            for (int column = 0; column + 1 < columns; ++column)
+            {
+                Point4i corners[4] =
+                {
+                    grid[(row    ) * columns + column    ],
+                    grid[(row    ) * columns + column + 1],
+                    grid[(row + 1) * columns + column + 1],
+                    grid[(row + 1) * columns + column    ],
+                };
+
+                static const int quad     [4] = { 0, 1, 2, 3 };
+                static const int triangles[6] = { 0, 1, 2, 0, 2, 3 };
+
+                if (quads)
+                {
+                    for (Point4i & corner : corners) corner[2] = z;
+
+                    rasterizer.fill_convex_polygon_z_buffer (corners, quad, quad + 4);
+
+                    z -= 1024;
+                    continue;
+                }
+
+                for (int triangle = 0; triangle < 2; ++triangle, z -= 1024)
+                {
+                    for (Point4i & corner : corners) corner[2] = z;
+
+                    rasterizer.fill_convex_polygon_z_buffer (corners, triangles + 3 * triangle, triangles + 3 * triangle + 3);
+                }
+            }
+        }
+
+        const std::vector< uint16_t > & overdraw = rasterizer.get_overdraw ();
+
+        size_t holes    = 0;
+        size_t overlaps = 0;
+
+        for (size_t y = 0; y < height; ++y)
+        {
+            for (size_t x = 0; x < width; ++x)
+            {
+                uint16_t writes = overdraw[color_buffer.offset_at (x, y)];
+
+                if (writes == 0) holes++;
+                if (writes >  1) overlaps++;
+            }
+        }
+
+        bool passed = holes == 0 && overlaps == 0;
+
+        std::printf
+        (
+            "%-10s %zu hilos %-8s celda %3d %-10s %s",
+            engine, workers, tiled ? "tiles" : "filas", cell, quads ? "cuadros" : "triangulos", passed ? "ok\n" : "FALLO"
+        );
+
+        if (!passed) std::printf (" (%zu pixels sin pintar, %zu pintados varias veces)\n", holes, overlaps);
+
+        return (passed);
+    }
+
+}
+
+int main ()
+{
+    if (!Rasterizer< Color_Buffer_Rgba8888 >::statistics)
+    {
+        std::printf ("hace falta compilar con RASTERIZER_STATISTICS=1\n");
+
+        return (EXIT_FAILURE);
+    }
+
+    static const int    cells  [] = { 3, 17, 90 };          // Triángulos del camino de stamps, medianos y grandes
+    static const size_t workers[] = { 1, 4 };
+
+    bool passed = true;
+
+    for (size_t worker_count : workers)
+    {
+        for (int tiled = 0; tiled < 2; ++tiled)
+        {
+            for (int cell : cells)
+            {
+                for (int quads = 0; quads < 2; ++quads)
+                {
+                    passed &= check< SCANLINE_ENGINE   > ("scanline"  , worker_count, tiled != 0, cell, quads != 0);
+                    passed &= check< HALF_SPACE_ENGINE > ("half-space", worker_count, tiled != 0, cell, quads != 0);
+                }
+            }
+        }
+    }
+
+    return (passed ? EXIT_SUCCESS : EXIT_FAILURE);
+}